@@ -0,0 +1,80 @@
+// Atomic operations on 32- and 64-bit integers.
+//
+// These compile to single RISC-V AMOs where there is one:
+// fetch-add to amoadd, exchange to amoswap and fetch-or to amoor,
+// all with .aqrl, so they also order the memory accesses around
+// them. Compare-and-swap is an lr/sc loop. Loads acquire and
+// stores release: nothing after the load moves before it, and
+// nothing before the store moves after it.
+
+static inline int
+atomic_load32(volatile int *p)
+{
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+atomic_store32(volatile int *p, int v)
+{
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+// Add n to *p; return the old value.
+static inline int
+atomic_fetch_add32(volatile int *p, int n)
+{
+  return __atomic_fetch_add(p, n, __ATOMIC_SEQ_CST);
+}
+
+// Or bits into *p; return the old value.
+static inline int
+atomic_fetch_or32(volatile int *p, int bits)
+{
+  return __atomic_fetch_or(p, bits, __ATOMIC_SEQ_CST);
+}
+
+// Set *p to v; return the old value.
+static inline int
+atomic_xchg32(volatile int *p, int v)
+{
+  return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+// If *p is old, set it to new and return 1; else return 0.
+static inline int
+atomic_cas32(volatile int *p, int old, int new)
+{
+  return __atomic_compare_exchange_n(p, &old, new, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64
+atomic_load64(volatile uint64 *p)
+{
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+atomic_store64(volatile uint64 *p, uint64 v)
+{
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static inline uint64
+atomic_fetch_add64(volatile uint64 *p, uint64 n)
+{
+  return __atomic_fetch_add(p, n, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64
+atomic_xchg64(volatile uint64 *p, uint64 v)
+{
+  return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+static inline int
+atomic_cas64(volatile uint64 *p, uint64 old, uint64 new)
+{
+  return __atomic_compare_exchange_n(p, &old, new, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
@@ -40,6 +40,8 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iexecdup(struct inode*);
+void            iexecput(struct inode*);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -52,7 +54,7 @@ struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
-void            itrunc(struct inode*);
+int             itrunc(struct inode*);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -63,6 +65,12 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kincref(void *);
+int             krefcnt(void *);
+
+// lockbench.c
+void            lockbenchinit(void);
+int             lockbench(int, uint64);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -70,6 +78,12 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// pagecache.c
+void            pagecacheinit(void);
+uint64          pagecache_get(struct inode*, uint);
+void            pagecache_drop(struct inode*);
+int             pagecache_reclaim(void);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -83,13 +97,15 @@ void            printfinit(void);
 
 // proc.c
 int             cpuid(void);
+void            cpuonline(void);
+int             is_cpu_online(int);
 void            exit(int);
 int             fork(void);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+struct proc*    findproc(int);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -108,10 +124,26 @@ void            procdump(void);
 int             get_cpu();
 int             set_cpu(int num_of_cpu);
 int             push_link(struct proc*, int*, struct spinlock*);
-int             delete_link(struct proc*, int*, struct spinlock*);
 int             pop_link(int*, struct spinlock*);
-int             choose_cpu();
+void            push_runnable(struct proc*, int);
+int             pop_runnable(int);
+int             steal_runnable(int);
+void            balance_tick(void);
+int             choose_cpu(struct proc*);
 int             cpu_process_count(int cpu_num);
+int             set_sched_policy(int);
+int             get_sched_policy(void);
+void            timeslice(int);
+void            preempt_disable(void);
+void            preempt_enable(void);
+void            cond_resched(void);
+int             setpriority(int, int);
+int             getpriority(int, uint64);
+int             sched_setaffinity(int, uint);
+int             sched_getaffinity(int);
+void            account(struct proc*, uint64*);
+int             getprocinfo(uint64, int);
+int             getcpuinfo(uint64, int);
 // swtch.S
 void            swtch(struct context*, struct context*);
 
@@ -119,6 +151,7 @@ void            swtch(struct context*, struct context*);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockstat(uint64, int, int);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
@@ -146,12 +179,29 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// timer.c
+void            timer_tick(uint);
+int             timer_sleep(uint);
+int             timer_next(uint*);
+void            hrtimer_run(uint64);
+int             hrtimer_next(uint64*);
+int             nanosleep(uint64);
+
+// trace.c
+void            trace(int, int, int, int);
+int             trace_read(int, uint64, int);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            send_ipi(int);
+int             ticks_update(void);
+void            clock_rearm(void);
+void            tick_stop(int);
+void            tick_start(int);
 
 // uart.c
 void            uartinit(void);
@@ -170,6 +220,9 @@ void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             cowfault(pagetable_t, uint64);
+int             lazyfault(struct proc*, uint64);
+int             uvmprefault(uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
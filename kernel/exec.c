@@ -4,20 +4,30 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 #include "defs.h"
 #include "elf.h"
 
-static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
+static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
 
+// The program's segments are not read in here: exec() only
+// records them, and lazyfault() pages each one in on first
+// touch, sharing unmodified pages between all the processes
+// running the same program through the page cache. A program
+// with more than NSEG loadable segments has the rest read in
+// at once, as they used to be.
 int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nseg = 0;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe = 0, *oldexe;
   struct proghdr ph;
+  struct segment seg[NSEG];
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
@@ -38,7 +48,7 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -46,17 +56,33 @@ exec(char *path, char **argv)
       continue;
     if(ph.memsz < ph.filesz)
       goto bad;
-    if(ph.vaddr + ph.memsz < ph.vaddr)
+    if(ph.vaddr + ph.memsz < ph.vaddr || ph.vaddr + ph.memsz > TRAPFRAME)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.off + ph.filesz < ph.off || ph.off + ph.filesz > ip->size)
       goto bad;
-    sz = sz1;
     if((ph.vaddr % PGSIZE) != 0)
       goto bad;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
-      goto bad;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
+    if(nseg == NSEG){
+      if(uvmalloc(pagetable, ph.vaddr, ph.vaddr + ph.memsz) == 0)
+        goto bad;
+      if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+        goto bad;
+      continue;
+    }
+    seg[nseg].va = ph.vaddr;
+    seg[nseg].memsz = ph.memsz;
+    seg[nseg].off = ph.off;
+    seg[nseg].filesz = ph.filesz;
+    seg[nseg].perm = PTE_R;
+    if(ph.flags & ELF_PROG_FLAG_WRITE)
+      seg[nseg].perm |= PTE_W;
+    if(ph.flags & ELF_PROG_FLAG_EXEC)
+      seg[nseg].perm |= PTE_X;
+    nseg++;
   }
+  exe = iexecdup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
@@ -110,11 +136,20 @@ exec(char *path, char **argv)
     
   // Commit to the user image.
   oldpagetable = p->pagetable;
+  oldexe = p->exe;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->exe = exe;
+  memmove(p->seg, seg, sizeof(seg));
+  p->nseg = nseg;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  if(oldexe){
+    begin_op();
+    iexecput(oldexe);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -125,6 +160,11 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    begin_op();
+    iexecput(exe);
+    end_op();
+  }
   return -1;
 }
 
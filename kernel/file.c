@@ -118,6 +118,9 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
+    // paging in addr may need the program's inode lock.
+    if(uvmprefault(addr, n) < 0)
+      return -1;
     ilock(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
@@ -154,6 +157,8 @@ filewrite(struct file *f, uint64 addr, int n)
     // might be writing a device like the console.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
     int i = 0;
+    if(uvmprefault(addr, n) < 0)
+      return -1;
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
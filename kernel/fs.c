@@ -283,6 +283,30 @@ idup(struct inode *ip)
   return ip;
 }
 
+// idup() for a process's program, p->exe. While any process
+// runs ip, writei() and itrunc() refuse to change it, since
+// its pages are read in on demand. exec() calls this with
+// ip locked, so a writer either finishes first or sees it.
+struct inode*
+iexecdup(struct inode *ip)
+{
+  acquire(&itable.lock);
+  ip->ref++;
+  ip->nexec++;
+  release(&itable.lock);
+  return ip;
+}
+
+// Drop a reference taken by iexecdup().
+void
+iexecput(struct inode *ip)
+{
+  acquire(&itable.lock);
+  ip->nexec--;
+  release(&itable.lock);
+  iput(ip);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -406,17 +430,22 @@ bmap(struct inode *ip, uint bn)
 
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
-void
+// Returns -1, changing nothing, if a process is running ip.
+int
 itrunc(struct inode *ip)
 {
   int i, j;
   struct buf *bp;
   uint *a;
 
+  if(ip->nexec > 0)
+    return -1;
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
       ip->addrs[i] = 0;
+      cond_resched();
     }
   }
 
@@ -424,8 +453,10 @@ itrunc(struct inode *ip)
     bp = bread(ip->dev, ip->addrs[NDIRECT]);
     a = (uint*)bp->data;
     for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
+      if(a[j]){
         bfree(ip->dev, a[j]);
+        cond_resched();
+      }
     }
     brelse(bp);
     bfree(ip->dev, ip->addrs[NDIRECT]);
@@ -434,6 +465,8 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  pagecache_drop(ip);
+  return 0;
 }
 
 // Copy stat information from inode.
@@ -472,6 +505,7 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
       break;
     }
     brelse(bp);
+    cond_resched();
   }
   return tot;
 }
@@ -493,6 +527,8 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(ip->nexec > 0)
+    return -1;  // a running program; see iexecdup()
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -503,10 +539,13 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     }
     log_write(bp);
     brelse(bp);
+    cond_resched();
   }
 
   if(off > ip->size)
     ip->size = off;
+  if(tot > 0)
+    pagecache_drop(ip);
 
   // write the i-node back to disk even if the size didn't change
   // because the loop above might have called bmap() and added a new
@@ -3,6 +3,7 @@
 // and pipe buffers. Allocates whole 4096-byte pages.
 
 #include "types.h"
+#include "atomic.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
@@ -23,10 +24,41 @@ struct {
   struct run *freelist;
 } kmem;
 
+// Each CPU keeps up to KCACHE free pages of its own, so most
+// kalloc()s and kfree()s touch no shared lock. An empty cache
+// is refilled from kmem KBATCH pages at a time, and a cache that
+// grows past KCACHE gives KBATCH back. Once kmem is empty as
+// well, kalloc() takes pages from other CPUs' caches, so every
+// free page can still be allocated; that is the only time a
+// cache's lock is taken by another CPU.
+#define KCACHE 64
+#define KBATCH 32
+
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+  char name[8];
+} kcache[NCPU];
+
+// References to each physical page, from kalloc() and kincref().
+// A copy-on-write page is shared by several page tables, and
+// kfree() frees it only when the last of them lets go.
+static volatile int refcnt[(PHYSTOP - KERNBASE) / PGSIZE];
+
+#define REFCNT(pa) (&refcnt[((uint64)(pa) - KERNBASE) / PGSIZE])
+
 void
 kinit()
 {
+  struct kcache *c;
+
   initlock(&kmem.lock, "kmem");
+  for(c = kcache; c < &kcache[NCPU]; c++){
+    safestrcpy(c->name, "kcache0", sizeof(c->name));
+    c->name[6] += c - kcache;
+    initlock(&c->lock, c->name);
+  }
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,48 +67,144 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    *REFCNT(p) = 1;
     kfree(p);
+  }
+}
+
+// Take another reference to page pa, for sharing it.
+void
+kincref(void *pa)
+{
+  if(atomic_fetch_add32(REFCNT(pa), 1) < 1)
+    panic("kincref");
+}
+
+// The number of references to page pa.
+int
+krefcnt(void *pa)
+{
+  return atomic_load32(REFCNT(pa));
+}
+
+// Detach up to max pages from the front of *list and return
+// them as a list of their own, adding how many to *n.
+static struct run*
+grab(struct run **list, int max, int *n)
+{
+  struct run *first = *list;
+  struct run **pp = list;
+  int i;
+
+  for(i = 0; i < max && *pp; i++)
+    pp = &(*pp)->next;
+  *list = *pp;
+  *pp = 0;
+  *n += i;
+  return i ? first : 0;
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Take a page from another CPU's cache, when kmem is empty.
+static struct run*
+steal(int self)
+{
+  struct kcache *c;
+  struct run *r = 0;
+
+  for(c = kcache; c < &kcache[NCPU] && r == 0; c++){
+    if(c == &kcache[self])
+      continue;
+    acquire(&c->lock);
+    r = c->freelist;
+    if(r){
+      c->freelist = r->next;
+      c->n--;
+    }
+    release(&c->lock);
+  }
+  return r;
+}
+
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last.
+// (The exception is when initializing the allocator;
+// see kinit above.)
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *batch, *last;
+  struct kcache *c;
+  int n;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if((n = atomic_fetch_add32(REFCNT(pa), -1)) > 1)
+    return;
+  if(n < 1)
+    panic("kfree: free page");
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  if(++c->n > KCACHE){
+    n = 0;
+    batch = grab(&c->freelist, KBATCH, &n);
+    c->n -= n;
+    for(last = batch; last->next; last = last->next)
+      ;
+    acquire(&kmem.lock);
+    last->next = kmem.freelist;
+    kmem.freelist = batch;
+    release(&kmem.lock);
+  }
+  release(&c->lock);
+  pop_off();
 }
 
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
-// Returns 0 if the memory cannot be allocated.
+// Returns 0 if the memory cannot be allocated, even after
+// taking back the page cache's unused pages.
 void *
 kalloc(void)
 {
   struct run *r;
+  struct kcache *c;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+again:
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  if(c->freelist == 0){
+    acquire(&kmem.lock);
+    c->freelist = grab(&kmem.freelist, KBATCH, &c->n);
+    release(&kmem.lock);
+  }
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->n--;
+  }
+  release(&c->lock);
+  if(r == 0)
+    r = steal(cpuid());
+  pop_off();
+  if(r == 0 && pagecache_reclaim() > 0)
+    goto again;
 
-  if(r)
+  if(r){
     memset((char*)r, 5, PGSIZE); // fill with junk
+    atomic_store32(REFCNT(r), 1);
+  }
   return (void*)r;
 }
@@ -0,0 +1,62 @@
+// Spinlock benchmark. Every process that calls lockbench()
+// hammers the same lock, so running it from processes pinned
+// to different CPUs measures acquire throughput and how long
+// waiters wait under contention, for whichever spinlock the
+// kernel was built with.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "lockbench.h"
+
+#define LB_HOLD 20  // loads and stores in the critical section
+
+struct {
+  struct spinlock lock;
+  uint64 count;
+} bench;
+
+void
+lockbenchinit(void)
+{
+  initlock(&bench.lock, "lockbench");
+}
+
+// Acquire and release the benchmark lock n times, and copy a
+// struct lockbench with the waits to user address dst.
+int
+lockbench(int n, uint64 dst)
+{
+  struct lockbench lb;
+  uint64 start, t;
+  int i, j, b;
+
+  if(n < 0)
+    return -1;
+  memset(&lb, 0, sizeof(lb));
+
+  start = r_time();
+  for(i = 0; i < n; i++){
+    t = r_time();
+    acquire(&bench.lock);
+    t = r_time() - t;
+    for(j = 0; j < LB_HOLD; j++)
+      bench.count++;
+    release(&bench.lock);
+
+    if(t > lb.max)
+      lb.max = t;
+    for(b = 0; b < LB_NHIST - 1 && t >= (1L << b); b++)
+      ;
+    lb.hist[b]++;
+  }
+  lb.elapsed = r_time() - start;
+
+  if(copyout(myproc()->pagetable, dst, (char*)&lb, sizeof(lb)) < 0)
+    return -1;
+  return 0;
+}
@@ -0,0 +1,9 @@
+// Spinlock benchmark results, as returned by lockbench().
+// Times are in mtime cycles, MTIME_HZ a second.
+#define LB_NHIST 32
+
+struct lockbench {
+  uint64 elapsed;         // from the first acquire to the last release
+  uint64 max;             // longest wait to acquire
+  uint64 hist[LB_NHIST];  // acquires by wait: 0 in hist[0], [2^(i-1), 2^i) in hist[i]
+};
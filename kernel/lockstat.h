@@ -0,0 +1,14 @@
+// Spinlock statistics, kept per lock name and returned by
+// lockstat(). Times are read with r_time(), so they count
+// mtime cycles, MTIME_HZ a second (100 ns each in qemu), not
+// CPU clock cycles.
+#define NLOCKSTAT 64  // lock names tracked
+
+struct lockstat {
+  char name[16];
+  uint64 acquire;     // acquisitions
+  uint64 contended;   // acquisitions that had to wait
+  uint64 spins;       // iterations spent waiting
+  uint64 hold;        // total time held
+  uint64 maxhold;     // longest time held
+};
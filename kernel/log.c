@@ -79,6 +79,7 @@ install_trans(int recovering)
       bunpin(dbuf);
     brelse(lbuf);
     brelse(dbuf);
+    cond_resched();
   }
 }
 
@@ -27,6 +27,8 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pagecacheinit(); // shared pages of executables
+    lockbenchinit(); // spinlock benchmark
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -41,5 +43,6 @@ main()
     plicinithart();   // ask PLIC for device interrupts
   }
 
+  cpuonline();        // choose_cpu() may now place processes here
   scheduler();        
 }
@@ -27,8 +27,11 @@
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid)) // machine software interrupt.
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define MTIME_HZ 10000000L              // mtime cycles per second, in qemu.
+#define TICK_INTERVAL (MTIME_HZ / HZ)   // cycles per clock tick; see param.h.
 
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
@@ -0,0 +1,199 @@
+// Page cache for demand-paged executables.
+//
+// Holds pages of file contents, keyed by (dev, inum, offset),
+// so that processes running the same program share its pages
+// instead of each reading its own copy. The cache holds one
+// reference to each page it keeps, and every page table that
+// maps the page holds another, so kfree() leaves a page alone
+// until the cache has dropped it and every process has unmapped
+// it. Cached pages are mapped without PTE_W; a store to one in
+// a writable segment copies it, see cowfault().
+//
+// A file cannot be written or truncated while a process runs it
+// (see iexecdup()), or the process would page in a mix of old
+// and new contents. Once none does, writing to or truncating it
+// drops its pages. When memory runs out, kalloc() calls
+// pagecache_reclaim() to give back the pages that no process
+// maps.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "defs.h"
+
+#define NPCPAGE 1024  // pages cached at most
+#define NPCHASH 64    // buckets, by inode
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;
+  uint64 pa;
+  struct pcpage *next;  // in bucket, or on the free list
+};
+
+struct {
+  struct spinlock lock;
+  struct pcpage page[NPCPAGE];
+  struct pcpage *bucket[NPCHASH];
+  struct pcpage *free;
+} pcache;
+
+#define PCHASH(dev, inum) (((dev) * 31 + (inum)) % NPCHASH)
+
+void
+pagecacheinit(void)
+{
+  struct pcpage *e;
+
+  initlock(&pcache.lock, "pagecache");
+  for(e = pcache.page; e < &pcache.page[NPCPAGE]; e++){
+    e->next = pcache.free;
+    pcache.free = e;
+  }
+}
+
+// Find the page at off in ip, and take a reference to it.
+// Caller must hold pcache.lock.
+static uint64
+lookup(struct inode *ip, uint off)
+{
+  struct pcpage *e;
+
+  for(e = pcache.bucket[PCHASH(ip->dev, ip->inum)]; e; e = e->next){
+    if(e->dev == ip->dev && e->inum == ip->inum && e->off == off){
+      kincref((void*)e->pa);
+      return e->pa;
+    }
+  }
+  return 0;
+}
+
+// Read the page at off in ip into a new page and cache it.
+// Returns the page with a reference for the caller, or 0.
+// Caller must hold ip->lock, which writei() and itrunc() also
+// hold when they drop ip's pages, so a page read before a
+// write can never be cached after it.
+static uint64
+readpage(struct inode *ip, uint off)
+{
+  struct pcpage *e;
+  char *mem;
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  if(readi(ip, 0, (uint64)mem, off, PGSIZE) < 0){
+    kfree(mem);
+    return 0;
+  }
+
+  acquire(&pcache.lock);
+  if((e = pcache.free) != 0){
+    pcache.free = e->next;
+    e->dev = ip->dev;
+    e->inum = ip->inum;
+    e->off = off;
+    e->pa = (uint64)mem;
+    e->next = pcache.bucket[PCHASH(ip->dev, ip->inum)];
+    pcache.bucket[PCHASH(ip->dev, ip->inum)] = e;
+    kincref(mem);
+  }
+  // else the cache is full, and mem stays the caller's alone.
+  release(&pcache.lock);
+  return (uint64)mem;
+}
+
+// Return a page holding the PGSIZE bytes of ip at off, zero
+// past the end of the file, with a reference for the caller,
+// who drops it with kfree(). Reads the page from ip if it is not
+// cached yet, so it may sleep: the caller must not hold ip->lock
+// or any spinlock. Code that copies to user memory under a lock
+// pages it in before taking the lock, see uvmprefault().
+// Returns 0 if out of memory or if the read fails.
+uint64
+pagecache_get(struct inode *ip, uint off)
+{
+  uint64 pa;
+
+  acquire(&pcache.lock);
+  pa = lookup(ip, off);
+  release(&pcache.lock);
+  if(pa)
+    return pa;
+
+  if(holdingsleep(&ip->lock))
+    panic("pagecache_get");
+  ilock(ip);
+  // someone else may have read it meanwhile.
+  acquire(&pcache.lock);
+  pa = lookup(ip, off);
+  release(&pcache.lock);
+  if(pa == 0)
+    pa = readpage(ip, off);
+  iunlock(ip);
+  return pa;
+}
+
+// Remove the entries for which drop(e, ip) is true, and
+// release the cache's reference to their pages.
+// Returns the number removed.
+static int
+evict(int (*drop)(struct pcpage*, struct inode*), struct inode *ip)
+{
+  struct pcpage *e, **pp;
+  int i, n = 0;
+
+  acquire(&pcache.lock);
+  for(i = 0; i < NPCHASH; i++){
+    if(ip && i != PCHASH(ip->dev, ip->inum))
+      continue;
+    for(pp = &pcache.bucket[i]; (e = *pp) != 0; ){
+      if(!drop(e, ip)){
+        pp = &e->next;
+        continue;
+      }
+      *pp = e->next;
+      kfree((void*)e->pa);
+      e->next = pcache.free;
+      pcache.free = e;
+      n++;
+    }
+  }
+  release(&pcache.lock);
+  return n;
+}
+
+static int
+ofinode(struct pcpage *e, struct inode *ip)
+{
+  return e->dev == ip->dev && e->inum == ip->inum;
+}
+
+static int
+unmapped(struct pcpage *e, struct inode *ip)
+{
+  return krefcnt((void*)e->pa) == 1;
+}
+
+// Forget ip's cached pages, after it is written or truncated.
+// Pages that processes have mapped stay theirs.
+void
+pagecache_drop(struct inode *ip)
+{
+  evict(ofinode, ip);
+}
+
+// Free the cached pages that no process maps.
+// Returns the number of pages freed.
+int
+pagecache_reclaim(void)
+{
+  return evict(unmapped, 0);
+}
@@ -1,4 +1,4 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      1024  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
@@ -11,3 +11,6 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#ifndef HZ
+#define HZ           10    // clock ticks per second; make HZ=n
+#endif
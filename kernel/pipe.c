@@ -79,6 +79,8 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
   int i = 0;
   struct proc *pr = myproc();
 
+  if(uvmprefault(addr, n) < 0)
+    return -1;
   acquire(&pi->lock);
   while(i < n){
     if(pi->readopen == 0 || pr->killed){
@@ -109,6 +111,8 @@ piperead(struct pipe *pi, uint64 addr, int n)
   struct proc *pr = myproc();
   char ch;
 
+  if(uvmprefault(addr, n) < 0)
+    return -1;
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
     if(pr->killed){
@@ -1,14 +1,37 @@
 #include "types.h"
+#include "atomic.h"
 #include "param.h"
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "sched.h"
+#include "trace.h"
+#include "procinfo.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// Bit i is set once hart i has come up in main().
+// Only online CPUs are given processes.
+volatile int cpus_online;
+
+// The process table grows on demand, a page of slots at a time,
+// up to NPROC slots. proc[i] is the slot with index i; slots are
+// never freed, so a struct proc pointer stays valid forever.
+// nslots is published after proc[nslots-1] is filled in, so
+// code that reads it with atomic_load32() without grow_lock
+// sees only complete slots. A slot's kernel stack is only held
+// while the slot is in use, plus a few idle ones for reuse;
+// see kstackalloc().
+struct proc *proc[NPROC];
+int nslots;
+struct spinlock grow_lock;  // also guards the kernel stack mappings
+
+#define NIDLESTACK 32  // kernel stacks kept on unused slots
+int nidlestacks;
+// Bumped for every kernel stack mapped, see kstackalloc().
+int kstack_gen;
 
 struct proc *initproc;
 
@@ -17,77 +40,128 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void move_proc(struct proc *p, int cpu);
 
 extern char trampoline[]; // trampoline.S
+extern pagetable_t kernel_pagetable; // vm.c
 
-// helps ensure that wakeups of wait()ing
-// parents are not lost. helps obey the
-// memory model when using p->parent.
-// must be acquired before any p->lock.
-struct spinlock wait_lock;
-extern uint64 cas(volatile void *addr, int expected, int newval);
-
-
-#ifdef OFF
-int balance_mode = 0;
-#else
-int balance_mode = 1;
-#endif
 
 int first_unused_proc = -1;
-int first_sleeping_proc = -1;
-int first_zombie_proc = -1;
 struct spinlock unused_lock;
-struct spinlock sleeping_lock;
-struct spinlock zombie_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void
-proc_mapstacks(pagetable_t kpgtbl) {
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
+// Sleeping processes, hashed by the channel they sleep on.
+// Each bucket is a list linked through next_proc and
+// protected by the bucket's lock.
+#define NSLEEPQ 61  // prime, since channels are addresses.
+struct sleepq {
+  struct spinlock lock;
+  volatile int first;
+} sleepq[NSLEEPQ];
+
+#define SLEEPQ(chan) (&sleepq[((uint64)(chan) >> 3) % NSLEEPQ])
+
+// Processes by pid, for findproc(). Each bucket is a list
+// linked through pid_next and protected by the bucket's lock.
+#define NPIDHASH 256
+struct pidhash {
+  struct spinlock lock;
+  struct proc *first;
+} pidhash[NPIDHASH];
+
+#define PIDHASH(pid) (&pidhash[(uint)(pid) % NPIDHASH])
+
+// Under SCHED_LEAST, runnable processes are moved between CPUs
+// every REBALANCE_TICKS ticks if the decayed loads of the busiest
+// and the idlest CPU differ by more than REBALANCE_THRESHOLD.
+#define REBALANCE_TICKS 5
+#define REBALANCE_THRESHOLD (2 * LOAD_SCALE)
+
+// Every BOOST_TICKS ticks each CPU runs one process from its lowest
+// non-empty level next, and moves it back up, so CPU-bound processes
+// are not starved by a stream of interactive ones.
+#define BOOST_TICKS 10
+
+// A woken process stays on the CPU it last ran on, or goes to the
+// waker's, unless that CPU has more than WAKE_IMBALANCE processes
+// over the one the policy would otherwise choose.
+#define WAKE_IMBALANCE 1
+
+// The best runnable queue level a process with this nice value
+// may use: positive nice values start lower down.
+static int
+min_level(int nice)
+{
+  if (nice <= 0)
+    return 0;
+  if (nice < 10)
+    return 1;
+  return NLEVEL - 1;
+}
+
+// Length of p's time slice in ticks. It doubles with each level
+// and is weighted by nice: 2x at -20, 1x at 0, down to 1 tick.
+static int
+slice_len(struct proc *p)
+{
+  int n = ((1 << p->level) * (20 - p->nice)) / 20;
+  return n < 1 ? 1 : n;
 }
 
 // initialize the proc table at boot time.
 void
 procinit(void)
 {
-  struct proc *p;
-  initlock(&zombie_lock, "zombie");
   initlock(&unused_lock, "unused");
-  initlock(&sleeping_lock, "sleeping");
+  struct sleepq *q;
+  for(q = sleepq; q < &sleepq[NSLEEPQ]; q++) {
+    initlock(&q->lock, "sleeping");
+    q->first = -1;
+  }
 
   initlock(&pid_lock, "nextpid");
-  initlock(&wait_lock, "wait_lock");
-  int index = -1;
-
-  for(p = proc; p < &proc[NPROC]; p++) {
-      index++;
-      p->index = index;
-      initlock(&p->lock, "proc");
-      initlock(&p->item_lock, "item");
-      p->next_proc = -1;
-      p->kstack = KSTACK((int) (p - proc));
-      push_link(p, &first_unused_proc, &unused_lock);
+  struct pidhash *h;
+  for(h = pidhash; h < &pidhash[NPIDHASH]; h++) {
+    initlock(&h->lock, "pidhash");
+    h->first = 0;
   }
+  initlock(&grow_lock, "grow");
 
   struct cpu *cpusTmp;
   for(cpusTmp = cpus; cpusTmp < &cpus[NCPU]; cpusTmp++) {
-    cpusTmp->first_runnable_proc = -1;
+    for(int level = 0; level < NLEVEL; level++) {
+      cpusTmp->first_runnable_proc[level] = -1;
+      cpusTmp->last_runnable_proc[level] = -1;
+    }
+    cpusTmp->queue_len = 0;
+    cpusTmp->npinned = 0;
     cpusTmp->processes_counter = 0;
+    cpusTmp->load_avg = 0;
     initlock(&cpusTmp->head_lock, "runnable head lock");
   }
 }
 
+// Mark this hart online, after it has finished
+// setting itself up and just before it starts scheduling.
+void
+cpuonline(void)
+{
+  atomic_fetch_or32(&cpus_online, 1 << cpuid());
+}
+
+int
+is_cpu_online(int num)
+{
+  return num >= 0 && num < NCPU && (cpus_online & (1 << num)) != 0;
+}
+
+// Whether p may run on CPU num: it must be online
+// and in p's affinity mask.
+static int
+cpu_allowed(struct proc *p, int num)
+{
+  return is_cpu_online(num) && (p->affinity & (1 << num)) != 0;
+}
+
 // Must be called with interrupts disabled,
 // to prevent race with process being moved
 // to a different CPU.
@@ -117,34 +191,190 @@ myproc(void) {
   return p;
 }
 
+// Make p findable by its pid.
+// Caller must hold p->lock.
+static void
+pid_insert(struct proc *p)
+{
+  struct pidhash *h = PIDHASH(p->pid);
+
+  acquire(&h->lock);
+  p->pid_next = h->first;
+  h->first = p;
+  release(&h->lock);
+}
+
+// Caller must hold p->lock.
+static void
+pid_remove(struct proc *p)
+{
+  struct pidhash *h = PIDHASH(p->pid);
+  struct proc **pp;
+
+  acquire(&h->lock);
+  for(pp = &h->first; *pp; pp = &(*pp)->pid_next){
+    if(*pp == p){
+      *pp = p->pid_next;
+      break;
+    }
+  }
+  p->pid_next = 0;
+  release(&h->lock);
+}
+
+// Look up a process by pid.
+// Returns it with p->lock held, or 0 if there is no such process.
+struct proc*
+findproc(int pid)
+{
+  struct pidhash *h = PIDHASH(pid);
+  struct proc *p;
+
+  if(pid <= 0)
+    return 0;
+
+  acquire(&h->lock);
+  for(p = h->first; p; p = p->pid_next)
+    if(p->pid == pid)
+      break;
+  release(&h->lock);
+  if(p == 0)
+    return 0;
+
+  // p->lock comes before the bucket lock, so p may have been
+  // freed, and even reused, before we got here.
+  acquire(&p->lock);
+  if(p->pid != pid){
+    release(&p->lock);
+    return 0;
+  }
+  return p;
+}
+
 int allocpid() {
-  int pid;
-  do {
-      pid = nextpid;
-  } while (cas(&nextpid, pid, pid + 1));
-  return pid;
+  return atomic_fetch_add32(&nextpid, 1);
+}
+
+// Give slot p a kernel stack at KSTACK(p->index), with
+// the page below it left unmapped as a guard, so that a
+// stack overflow faults. Harts do not flush each other's
+// TLBs, so another hart may still hold a translation for the
+// slot's previous stack. The mapping gets a new kstack_gen,
+// and scheduler() flushes before running p on a hart whose
+// last flush is older. Only a hart running p uses its stack.
+// Returns -1 if out of memory.
+static int
+kstackalloc(struct proc *p)
+{
+  uint64 va = KSTACK(p->index);
+  char *pa;
+
+  if((pa = kalloc()) == 0)
+    return -1;
+  acquire(&grow_lock);
+  if(mappages(kernel_pagetable, va, PGSIZE, (uint64)pa, PTE_R | PTE_W) != 0){
+    release(&grow_lock);
+    kfree(pa);
+    return -1;
+  }
+  p->kstack_gen = atomic_fetch_add32(&kstack_gen, 1) + 1;
+  release(&grow_lock);
+  sfence_vma();
+  p->kstack = va;
+  return 0;
+}
+
+// Keep p's kernel stack for the next process in the slot,
+// unless NIDLESTACK unused slots already have one; then
+// unmap and free it.
+static void
+kstackfree(struct proc *p)
+{
+  if(p->kstack == 0)
+    return;
+  acquire(&grow_lock);
+  if(nidlestacks < NIDLESTACK){
+    nidlestacks++;
+  } else {
+    uvmunmap(kernel_pagetable, p->kstack, 1, 1);
+    p->kstack = 0;
+  }
+  release(&grow_lock);
+}
+
+// Add a page worth of slots to the process table and put
+// them on the unused list. Their stacks come in allocproc().
+// Returns -1 if the table is full or out of memory.
+static int
+procgrow(void)
+{
+  struct proc *chunk, *p;
+  int i, n;
+
+  acquire(&grow_lock);
+  if(first_unused_proc != -1){
+    // someone else grew the table while we waited.
+    release(&grow_lock);
+    return 0;
+  }
+  n = PGSIZE / sizeof(struct proc);
+  if(n > NPROC - nslots)
+    n = NPROC - nslots;
+  if(n <= 0 || (chunk = (struct proc*)kalloc()) == 0){
+    release(&grow_lock);
+    return -1;
+  }
+  memset(chunk, 0, PGSIZE);
+  for(i = 0; i < n; i++){
+    p = &chunk[i];
+    p->index = nslots;
+    p->affinity = ALL_CPUS;
+    initlock(&p->lock, "proc");
+    initlock(&p->item_lock, "item");
+    initlock(&p->wait_lock, "wait_lock");
+    p->next_proc = -1;
+    proc[nslots] = p;
+    atomic_store32(&nslots, nslots + 1);
+    push_link(p, &first_unused_proc, &unused_lock);
+  }
+  release(&grow_lock);
+  return 0;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// Take a slot off the unused list, growing the table if
+// there are none. Initialize state required to run in the
+// kernel, and return with p->lock held.
+// If the table is full, or a memory allocation fails, return 0.
 static struct proc*
 allocproc(void)
 {
   struct proc *p;
-  int first_link = pop_link(&first_unused_proc, &unused_lock);
-  if (first_link != -1) {
-    p = &proc[first_link];
-    acquire(&p->lock);
-    goto found;
+  int first_link;
+
+  while((first_link = pop_link(&first_unused_proc, &unused_lock)) == -1)
+    if(procgrow() < 0)
+      return 0;
+  p = proc[first_link];
+  acquire(&p->lock);
+
+  if(p->kstack){
+    acquire(&grow_lock);
+    nidlestacks--;
+    release(&grow_lock);
+  } else if(kstackalloc(p) < 0){
+    push_link(p, &first_unused_proc, &unused_lock);
+    release(&p->lock);
+    return 0;
   }
-  return 0;
 
-found:
   p->pid = allocpid();
+  pid_insert(p);
   p->state = USED;
 
+  p->utime = p->stime = p->wtime = 0;
+  p->nvcsw = p->nivcsw = 0;
+  p->last_cpu = -1;
+
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
     freeproc(p);
     release(&p->lock);
@@ -181,18 +411,23 @@ freeproc(struct proc *p)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
+  p->nseg = 0;
+  if(p->pid)
+    pid_remove(p);
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
-  int res = delete_link(p, &first_zombie_proc, &zombie_lock);
-
-  if (res != -1) {
-    p->state = UNUSED;
-    push_link(p, &first_unused_proc, &unused_lock);
-  }
+  p->nice = 0;
+  p->preempt_count = 0;
+  p->affinity = ALL_CPUS;
+  p->level = 0;
+  p->slice_ticks = 0;
+  p->state = UNUSED;
+  kstackfree(p);
+  push_link(p, &first_unused_proc, &unused_lock);
 }
 
 // Create a user page table for a given process,
@@ -272,7 +507,9 @@ userinit(void)
   p->cwd = namei("/");
 
   p->state = RUNNABLE;
-  push_link(p, &cpus[0].first_runnable_proc, &cpus[0].head_lock);
+  p->stamp = r_time();
+  atomic_fetch_add32(&cpus[0].processes_counter, 1);
+  sched_class->enqueue(p, 0);
   release(&p->lock);
 }
 
@@ -281,14 +518,16 @@ userinit(void)
 int
 growproc(int n)
 {
-  uint sz;
+  uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    // Only reserve the address space; usertrap() maps
+    // each page on first touch, see lazyfault().
+    if(sz + n > TRAPFRAME)
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
@@ -296,6 +535,34 @@ growproc(int n)
   return 0;
 }
 
+// Add child to the front of parent's list of children.
+// Caller must hold parent->wait_lock.
+static void
+add_child(struct proc *parent, struct proc *child)
+{
+  child->parent = parent;
+  child->prev_sibling = 0;
+  child->next_sibling = parent->first_child;
+  if(parent->first_child)
+    parent->first_child->prev_sibling = child;
+  parent->first_child = child;
+}
+
+// Unlink child from parent's list of children.
+// Caller must hold parent->wait_lock.
+static void
+remove_child(struct proc *parent, struct proc *child)
+{
+  if(child->prev_sibling)
+    child->prev_sibling->next_sibling = child->next_sibling;
+  else
+    parent->first_child = child->next_sibling;
+  if(child->next_sibling)
+    child->next_sibling->prev_sibling = child->prev_sibling;
+  child->next_sibling = 0;
+  child->prev_sibling = 0;
+}
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int
@@ -310,8 +577,14 @@ fork(void)
     return -1;
   }
 
+  // np is neither RUNNABLE nor anyone's child yet, so nothing
+  // else uses it. Copy without its lock, so that the copy of
+  // a big process can be preempted in uvmcopy().
+  release(&np->lock);
+
   // Copy user memory from parent to child.
   if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+    acquire(&np->lock);
     freeproc(np);
     release(&np->lock);
     return -1;
@@ -329,49 +602,63 @@ fork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  if(p->exe)
+    np->exe = iexecdup(p->exe);
+  memmove(np->seg, p->seg, sizeof(p->seg));
+  np->nseg = p->nseg;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
 
-  release(&np->lock);
+  acquire(&p->wait_lock);
+  add_child(p, np);
 
-  acquire(&wait_lock);
-  np->parent = p;
+  np->nice = p->nice;
+  np->affinity = p->affinity;
+  np->level = min_level(np->nice);
+  np->num_of_cpu = p->num_of_cpu;
+  np->num_of_cpu = sched_class->select_cpu(np, 0);
+  atomic_fetch_add32(&cpus[np->num_of_cpu].processes_counter, 1);
 
-  if (balance_mode) {
-    int chosen_cpu = choose_cpu();
-    np->num_of_cpu = chosen_cpu;
-
-    if (chosen_cpu != p->num_of_cpu)
-        while(cas(&cpus[chosen_cpu].processes_counter, cpus[chosen_cpu].processes_counter, cpus[chosen_cpu].processes_counter + 1) != 0);
-  } else {
-    np->num_of_cpu = p->num_of_cpu;
-  }
-    
-  release(&wait_lock);
+  release(&p->wait_lock);
 
   acquire(&np->lock);
   np->state = RUNNABLE;
-  push_link(np, &cpus[np->num_of_cpu].first_runnable_proc, &cpus[np->num_of_cpu].head_lock);
+  np->stamp = r_time();
+  trace(TRACE_FORK, p->pid, np->num_of_cpu, pid);
+  sched_class->enqueue(np, np->num_of_cpu);
   release(&np->lock);
 
   return pid;
 }
 
-// Pass p's abandoned children to init.
-// Caller must hold wait_lock.
+// Pass p's abandoned children, exited or not, to init.
+// Caller must hold p->wait_lock.
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
+  struct proc *pp, *next;
+
+  if(p->first_child == 0)
+    return;
+
+  acquire(&initproc->wait_lock);
+  for(pp = p->first_child; pp; pp = next){
+    next = pp->next_sibling;
+    add_child(initproc, pp);
+  }
+  p->first_child = 0;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
+  if(p->first_zombie){
+    while((pp = p->first_zombie) != 0){
+      p->first_zombie = pp->next_zombie;
+      pp->next_zombie = initproc->first_zombie;
+      initproc->first_zombie = pp;
     }
+    wakeup(initproc);
   }
+  release(&initproc->wait_lock);
 }
 
 // Exit the current process.  Does not return.
@@ -381,6 +668,7 @@ void
 exit(int status)
 {
   struct proc *p = myproc();
+  struct proc *pp;
 
   if(p == initproc)
     panic("init exiting");
@@ -396,24 +684,41 @@ exit(int status)
 
   begin_op();
   iput(p->cwd);
+  if(p->exe)
+    iexecput(p->exe);
   end_op();
   p->cwd = 0;
-
-  acquire(&wait_lock);
+  p->exe = 0;
 
   // Give any children to init.
+  acquire(&p->wait_lock);
   reparent(p);
+  release(&p->wait_lock);
+
+  // Lock our parent's child lists. The parent may be exiting
+  // too and handing us to init, so check once it is locked.
+  for(;;){
+    pp = p->parent;
+    acquire(&pp->wait_lock);
+    if(pp == p->parent)
+      break;
+    release(&pp->wait_lock);
+  }
+
+  p->next_zombie = pp->first_zombie;
+  pp->first_zombie = p;
 
   // Parent might be sleeping in wait().
-  wakeup(p->parent);
+  wakeup(pp);
   
   acquire(&p->lock);
 
   p->xstate = status;
   p->state = ZOMBIE;
-  push_link(p, &first_zombie_proc, &zombie_lock);
+  atomic_fetch_add32(&cpus[p->num_of_cpu].processes_counter, -1);
+  trace(TRACE_EXIT, p->pid, p->num_of_cpu, status);
 
-  release(&wait_lock);
+  release(&pp->wait_lock);
 
   // Jump into the scheduler, never to return.
   sched();
@@ -426,46 +731,45 @@ int
 wait(uint64 addr)
 {
   struct proc *np;
-  int havekids, pid;
+  int pid;
   struct proc *p = myproc();
 
-  acquire(&wait_lock);
+  // the status is copied out with locks held.
+  if(addr != 0 && uvmprefault(addr, sizeof(int)) < 0)
+    return -1;
+
+  acquire(&p->wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      if(np->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(np);
-          release(&np->lock);
-          release(&wait_lock);
-          return pid;
-        }
+    np = p->first_zombie;
+    if(np){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+
+      pid = np->pid;
+      if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                              sizeof(np->xstate)) < 0) {
         release(&np->lock);
+        release(&p->wait_lock);
+        return -1;
       }
+      p->first_zombie = np->next_zombie;
+      np->next_zombie = 0;
+      remove_child(p, np);
+      freeproc(np);
+      release(&np->lock);
+      release(&p->wait_lock);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || p->killed){
-      release(&wait_lock);
+    if(p->first_child == 0 || p->killed){
+      release(&p->wait_lock);
       return -1;
     }
     
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(p, &p->wait_lock);  //DOC: wait-sleep
   }
 }
 
@@ -481,22 +785,66 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
+  uint64 start;
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
-    // printf("!!!");
-    int first_proc_id = pop_link(&c->first_runnable_proc, &c->head_lock);
-    if (first_proc_id >= 0) {
-      p = &proc[first_proc_id];
-
+    p = sched_class->pick_next(id);
+    if (p) {
       acquire(&p->lock);  
+      if (!cpu_allowed(p, id)) {
+        // Its affinity changed while it was queued here.
+        move_proc(p, sched_class->select_cpu(p, 0));
+        sched_class->enqueue(p, p->num_of_cpu);
+        release(&p->lock);
+        continue;
+      }
       p->state = RUNNING;
+      atomic_store32(&c->need_resched, 0);
+      if (c->tlb_gen - p->kstack_gen < 0) {
+        // p's stack was mapped after this hart's last flush,
+        // maybe over a stale translation; see kstackalloc().
+        c->tlb_gen = atomic_load32(&kstack_gen);
+        sfence_vma();
+      }
       c->proc = p;
+      account(p, &p->wtime);
+      p->last_cpu = id;
+      trace(TRACE_SWITCH_IN, p->pid, id, p->level);
+      start = r_time();
       swtch(&c->context, &p->context);
+      c->busy += r_time() - start;
+      trace(TRACE_SWITCH_OUT, p->pid, id, p->state);
 
       c->proc = 0;
       release(&p->lock);
+    } else {
+      // Nothing to run here or to steal. Sleep until the next
+      // timer interrupt, or until push_runnable() sends an IPI.
+      // idle is published before the queue is checked one last
+      // time, so a producer either sees idle or we see its process.
+      // The hart's tick is stopped while it waits, since
+      // only a push or a timer deadline can give it work.
+      // idle is cleared before the tick restarts, even if
+      // there was no wait: hart 0 may have seen this hart
+      // idle and stopped its own tick, see tick_stop().
+      // Interrupts stay off from the check until after wfi: an
+      // IPI handled in between would be cleared, and wfi would
+      // then wait for an interrupt that never comes. A pending
+      // interrupt still ends wfi with interrupts off, and is
+      // taken once they are back on.
+      intr_off();
+      atomic_store32(&c->idle, 1);
+      __sync_synchronize();
+      if (atomic_load32(&c->queue_len) == 0) {
+        tick_stop(id);
+        wfi();
+      }
+      atomic_store32(&c->idle, 0);
+      tick_start(id);
+      intr_on();
     }
   }
 }
@@ -523,11 +871,31 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  account(p, &p->stime);
+  if(p->state == SLEEPING)
+    p->nvcsw++;
+  else if(p->state == RUNNABLE)
+    p->nivcsw++;
+
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
 }
 
+// Charge the time since p->stamp to *counter, one of
+// p's utime, stime or wtime, and start timing afresh.
+// The running process charges itself, on the way into and
+// out of the kernel and in sched(); the scheduler charges
+// wtime under p->lock as it switches to p.
+void
+account(struct proc *p, uint64 *counter)
+{
+  uint64 now = r_time();
+
+  *counter += now - p->stamp;
+  p->stamp = now;
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
@@ -536,11 +904,92 @@ yield(void)
   acquire(&p->lock);
   volatile int num_of_cpu = p->num_of_cpu;
   p->state = RUNNABLE;
-  push_link(p, &cpus[num_of_cpu].first_runnable_proc, &cpus[num_of_cpu].head_lock);
+  sched_class->enqueue(p, num_of_cpu);
   sched();
   release(&p->lock);
 }
 
+// Called on the way out of a trap. Charge a clock tick to the
+// running process if tick is set, moving it down a level once it
+// has used its whole slice. Give up the CPU if the slice is used
+// up or wake_proc() queued a better process here. Inside a
+// preempt_disable() section, leave need_resched set instead;
+// preempt_enable() or cond_resched() will yield later.
+void
+timeslice(int tick)
+{
+  struct proc *p = myproc();
+  int resched;
+
+  if (tick) {
+    acquire(&p->lock);
+    resched = ++p->slice_ticks >= slice_len(p);
+    if (resched) {
+      p->slice_ticks = 0;
+      if (p->level < NLEVEL - 1)
+        p->level++;
+    }
+    release(&p->lock);
+  } else {
+    resched = 0;
+  }
+
+  push_off();
+  if (atomic_load32(&mycpu()->need_resched))
+    resched = 1;
+  if (resched && p->preempt_count > 0) {
+    atomic_store32(&mycpu()->need_resched, 1);
+    resched = 0;
+  }
+  pop_off();
+
+  if (resched)
+    yield();
+}
+
+// Kernel preemption. While a process's preempt_count is above
+// zero, a clock tick or a better wakeup does not take the CPU
+// away from it in kerneltrap(); it is deferred until the count
+// drops back to zero, or to the next cond_resched(). Sleeplock
+// holders stay preemptible, as in kerneltrap() before. The
+// count is private to the process.
+void
+preempt_disable(void)
+{
+  myproc()->preempt_count++;
+}
+
+void
+preempt_enable(void)
+{
+  struct proc *p = myproc();
+
+  if (--p->preempt_count < 0)
+    panic("preempt_enable");
+  if (p->preempt_count == 0)
+    cond_resched();
+}
+
+// A preemption point, for long loops in the kernel: give up the
+// CPU if a reschedule is pending. The caller may hold sleeplocks,
+// but not spinlocks; with interrupts off this does nothing.
+void
+cond_resched(void)
+{
+  struct cpu *c;
+  int resched;
+
+  if (myproc() == 0)
+    return;
+  push_off();
+  c = mycpu();
+  resched = atomic_load32(&c->need_resched) && c->noff == 1 && c->intena;
+  pop_off();
+
+  if (resched)
+    yield();
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -568,20 +1017,26 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *q = SLEEPQ(chan);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
+  // Once we hold p->lock and are on chan's
+  // wait queue, we can be guaranteed that we
+  // won't miss any wakeup, so it's okay to release lk.
 
   acquire(&p->lock);  //DOC: sleeplock1
-  push_link(p, &first_sleeping_proc, &sleeping_lock);
-  release(lk);
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  atomic_fetch_add32(&cpus[p->num_of_cpu].processes_counter, -1);
+
+  acquire(&q->lock);
+  p->next_proc = q->first;
+  q->first = p->index;
+  release(&q->lock);
+
+  release(lk);
 
   sched();
 
@@ -593,65 +1048,109 @@ sleep(void *chan, struct spinlock *lk)
   acquire(lk);
 }
 
+// Mark a sleeping process runnable and queue it on the CPU
+// the scheduling policy picks for it, with a fresh time slice
+// at the best level its nice value allows. If that is a better
+// level than the one of the process running there, preempt it.
+// Caller must hold p->lock, and must have taken p
+// off its wait queue.
+static void
+wake_proc(struct proc *p)
+{
+  struct sched_class *sc = sched_class;
+  struct proc *cur;
+  int cpu;
+
+  p->state = RUNNABLE;
+  p->stamp = r_time();
+  p->level = min_level(p->nice);
+  p->slice_ticks = 0;
+  cpu = p->num_of_cpu = sc->select_cpu(p, 1);
+  atomic_fetch_add32(&cpus[cpu].processes_counter, 1);
+  trace(TRACE_WAKEUP, p->pid, cpu, cpuid());
+
+  sc->enqueue(p, cpu);
+
+  // cur may change under us; at worst a process gets
+  // preempted early or keeps the rest of its slice.
+  cur = cpus[cpu].proc;
+  if (cur && cur != p && p->level < cur->level) {
+    atomic_store32(&cpus[cpu].need_resched, 1);
+    if (cpu != cpuid())
+      send_ipi(cpu);
+  }
+}
+
 // Wake up all processes sleeping on chan.
+// Only chan's wait queue is searched, so the cost does not
+// depend on how many processes sleep on other channels.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  acquire(&sleeping_lock);
+  struct sleepq *q = SLEEPQ(chan);
+  struct proc *p;
+  int i, next, prev = -1, woken = -1;
 
-  if (first_sleeping_proc < 0) {
-    release(&sleeping_lock);
+  // Callers hold the lock that sleepers on chan pass to
+  // sleep(), and sleep() queues itself before releasing it,
+  // so an empty queue seen here means nobody to wake.
+  if (q->first == -1)
     return;
-  }
-
-  struct proc *p = &proc[first_sleeping_proc];
-  acquire(&p->lock);
-  release(&sleeping_lock);
 
-  volatile int next_proc = p->next_proc;
-
-  struct cpu *c;
-  if (p->state == SLEEPING && p->chan == chan) {
-      if(delete_link(p, &first_sleeping_proc, &sleeping_lock)){
-          p->state = RUNNABLE;
-          p->num_of_cpu = p->num_of_cpu;
-
-          if (balance_mode) {
-              int chosen_cpu = choose_cpu();
-              p->num_of_cpu = chosen_cpu;
-              if (chosen_cpu != p->num_of_cpu)
-                while(cas(&cpus[chosen_cpu].processes_counter, cpus[chosen_cpu].processes_counter, cpus[chosen_cpu].processes_counter + 1) != 0);
-          }
-
-          c = &cpus[p->num_of_cpu];
-          push_link(p, &c->first_runnable_proc, &c->head_lock);
-      }
+  // Unlink the sleepers on chan into a private list. A process
+  // taken off the queue here is owned by this wakeup; kill()
+  // will not queue it a second time.
+  acquire(&q->lock);
+  for (i = q->first; i != -1; i = next) {
+    p = proc[i];
+    next = p->next_proc;
+    if (p->chan == chan) {
+      if (prev == -1)
+        q->first = next;
+      else
+        proc[prev]->next_proc = next;
+      p->next_proc = woken;
+      woken = i;
+    } else {
+      prev = i;
+    }
   }
-  release(&p->lock);
-  while (next_proc > 0) {
-    p = &proc[next_proc];
+  release(&q->lock);
+
+  while (woken != -1) {
+    p = proc[woken];
+    woken = p->next_proc;
+    // Waits for p to finish switching out in sleep().
     acquire(&p->lock);
-    next_proc = p->next_proc;
-
-    if (p->state == SLEEPING && p->chan == chan) {
-        if(delete_link(p, &first_sleeping_proc, &sleeping_lock)){
-            p->state = RUNNABLE;
-            p->num_of_cpu = p->num_of_cpu;
-
-            if (balance_mode) {
-                int chosen_cpu = choose_cpu();
-                p->num_of_cpu = chosen_cpu;
-                if (chosen_cpu != p->num_of_cpu)
-                  while(cas(&cpus[chosen_cpu].processes_counter, cpus[chosen_cpu].processes_counter, cpus[chosen_cpu].processes_counter + 1) != 0);
-            }
-
-            c = &cpus[p->num_of_cpu];
-            push_link(p, &c->first_runnable_proc, &c->head_lock);
-        }
+    wake_proc(p);
+    release(&p->lock);
+  }
+}
+
+// Take a sleeping process off its wait queue.
+// Returns 0 if a wakeup() already did. Caller must hold p->lock.
+static int
+sleepq_remove(struct proc *p)
+{
+  struct sleepq *q = SLEEPQ(p->chan);
+  int i, prev = -1, found = 0;
+
+  acquire(&q->lock);
+  for (i = q->first; i != -1; i = proc[i]->next_proc) {
+    if (i == p->index) {
+      if (prev == -1)
+        q->first = p->next_proc;
+      else
+        proc[prev]->next_proc = p->next_proc;
+      p->next_proc = -1;
+      found = 1;
+      break;
     }
-    release(&p->lock);  
-  } 
+    prev = i;
+  }
+  release(&q->lock);
+  return found;
 }
 
 // Kill the process with the given pid.
@@ -661,24 +1160,16 @@ int
 kill(int pid)
 {
   struct proc *p;
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        int res = delete_link(p, &first_sleeping_proc, &sleeping_lock);
-        // Wake process from sleep().
-        if (res > 0) {
-          p->state = RUNNABLE;
-          push_link(p, &cpus[p->num_of_cpu].first_runnable_proc, &cpus[p->num_of_cpu].head_lock);
-        }
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING && sleepq_remove(p)){
+    // Wake process from sleep().
+    wake_proc(p);
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 // Copy to either a user address, or kernel address,
@@ -728,7 +1219,9 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  int n = atomic_load32(&nslots);
+  for(int i = 0; i < n; i++){
+    p = proc[i];
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -749,86 +1242,55 @@ int get_cpu() {
     return num_of_cpu;
 }
 
+// Pin the calling process to CPU num_of_cpu, which must be
+// online: its affinity mask becomes that CPU alone, so neither
+// stealing nor rebalancing moves it away again.
 int set_cpu(int num_of_cpu) {
     struct proc* proc = myproc();
-    if(cas(&proc->num_of_cpu, proc->num_of_cpu, num_of_cpu) == 0) {
-      yield();
-      return num_of_cpu;
-    }
-    return -99;
+
+    if (!is_cpu_online(num_of_cpu))
+      return -1;
+    acquire(&proc->lock);
+    proc->affinity = 1 << num_of_cpu;
+    move_proc(proc, num_of_cpu);
+    release(&proc->lock);
+
+    yield();
+    return num_of_cpu;
 }
 
-int push_link(struct proc* to_push, int* first_proc, struct spinlock* lock) {
-    acquire(lock);
-    if (*first_proc >= 0) {
-        struct proc *prev_proc;
-        struct proc *curr_proc = &proc[*first_proc];
-        acquire(&curr_proc->item_lock);
-        release(lock);
-        while (curr_proc->next_proc >= 0) {
-            prev_proc = curr_proc;
-            curr_proc = &proc[curr_proc->next_proc];
-            acquire(&curr_proc->item_lock);
-            release(&prev_proc->item_lock);
-        }
-        curr_proc->next_proc = to_push->index;
-        to_push->next_proc = -1;
-        release(&curr_proc->item_lock);
-    } else {
-        *first_proc = to_push->index;
-        to_push->next_proc = -1;
-        release(lock);
+// Assign p, which is runnable or running, to CPU cpu,
+// keeping processes_counter in step. Caller must hold p->lock,
+// and must queue p on cpu if it is on no runnable queue.
+static void
+move_proc(struct proc *p, int cpu)
+{
+    int old_cpu = p->num_of_cpu;
+
+    p->num_of_cpu = cpu;
+    if (old_cpu != cpu) {
+      atomic_fetch_add32(&cpus[old_cpu].processes_counter, -1);
+      atomic_fetch_add32(&cpus[cpu].processes_counter, 1);
+      trace(TRACE_MIGRATE, p->pid, cpu, old_cpu);
     }
-    return to_push->index;
 }
 
-int delete_link(struct proc* to_remove, int* first_proc, struct spinlock* lock) {
-    struct proc *curr_proc;
-    struct proc *prev_proc;
+// Push to_push at the head of the list.
+int push_link(struct proc* to_push, int* first_proc, struct spinlock* lock) {
     acquire(lock);
-    int returned_index = -1;
-    if(*first_proc >= 0) {
-        curr_proc = &proc[*first_proc];
-        acquire(&curr_proc->item_lock);
-        if (curr_proc->index != to_remove->index) {
-            release(lock);
-            while (curr_proc->next_proc != to_remove->index) {
-                if (curr_proc->next_proc >= 0) {
-                    returned_index = to_remove->next_proc;
-                    prev_proc = curr_proc;
-                    curr_proc = &proc[prev_proc->next_proc];
-                    release(&prev_proc->item_lock);
-                    acquire(&curr_proc->item_lock);
-                }
-            }
-            if (returned_index == -1) {
-              release(&curr_proc->item_lock);
-              return returned_index;
-            }
-            acquire(&to_remove->item_lock);
-            curr_proc->next_proc = to_remove->next_proc;
-            to_remove->next_proc = -1;
-            release(&to_remove->item_lock);
-            release(&curr_proc->item_lock);
-            return returned_index;
-        } else {
-            *first_proc = to_remove->next_proc;
-            to_remove->next_proc = -1;
-            release(&curr_proc->item_lock);
-            release(lock);
-            return returned_index;
-        }
-    } else {
-        release(lock);
-        return returned_index;
-    }
+    acquire(&to_push->item_lock);
+    to_push->next_proc = *first_proc;
+    *first_proc = to_push->index;
+    release(&to_push->item_lock);
+    release(lock);
+    return to_push->index;
 }
 
 int pop_link(int* first_proc, struct spinlock* lock) {
     acquire(lock);
     int res = -1;
     if (*first_proc >= 0) {
-      struct proc *p = &proc[*first_proc];
+      struct proc *p = proc[*first_proc];
       acquire(&p->item_lock);
       *first_proc = p->next_proc;
       p->next_proc = -1;
@@ -840,20 +1302,592 @@ int pop_link(int* first_proc, struct spinlock* lock) {
     return res;
 }
 
-int choose_cpu() {
-    int cpu = 0;
-    int min = cpus[0].processes_counter;
+// Wake one idle online hart other than busy, to steal from it.
+static void
+kick_idle(int busy)
+{
     int i;
-    for (i = 1; i < NCPU; i++){
-        if (min > cpus[i].processes_counter){
-            min = cpus[i].processes_counter;
+
+    for (i = 0; i < NCPU; i++) {
+        if (i != busy && is_cpu_online(i) && atomic_load32(&cpus[i].idle)) {
+            send_ipi(i);
+            return;
+        }
+    }
+}
+
+// Append p to the tail of cpu_num's runnable queue.
+// Lock-free for any number of producers: the tail slot is
+// claimed with one atomic exchange, then the old tail is
+// linked to p.
+// An idle target CPU is woken with a reschedule IPI.
+// A consumer that sees the old tail without a successor
+// waits in pop_runnable() for that link to appear.
+void push_runnable(struct proc* p, int cpu_num) {
+    struct cpu *c = &cpus[cpu_num];
+    int level = p->level;
+    int prev;
+
+    // No interrupts between claiming the tail and linking it,
+    // or a rebalance from clockintr() on this hart could spin
+    // in pop_runnable() waiting for the link.
+    push_off();
+    p->next_proc = -1;
+    p->pinned = p->affinity == (1 << cpu_num);
+    if (p->pinned)
+        atomic_fetch_add32(&c->npinned, 1);
+    prev = atomic_xchg32(&c->last_runnable_proc[level], p->index);
+
+    if (prev == -1)
+        atomic_store32(&c->first_runnable_proc[level], p->index);
+    else
+        atomic_store32(&proc[prev]->next_proc, p->index);
+    atomic_fetch_add32(&c->queue_len, 1);
+
+    // Wake the owning hart if it is idle in scheduler(). If it is
+    // busy and p has to wait behind another process, wake an idle
+    // hart to steal; with no tick, it would not notice by itself.
+    __sync_synchronize();
+    if (atomic_load32(&c->idle))
+        send_ipi(cpu_num);
+    else if (c->proc != 0 && !p->pinned &&
+             atomic_load32(&c->queue_len) - (c->proc == p) > 0)
+        kick_idle(cpu_num);
+    pop_off();
+}
+
+// Put p back at the head of its level of cpu_num's runnable
+// queue, where pop_runnable() took it from. Producers only
+// touch the head when the queue is empty, so a non-empty queue
+// just gets a new head; an empty one is pushed to at the tail.
+// Caller must hold p->lock.
+static void
+push_head(struct proc *p, int cpu_num)
+{
+    struct cpu *c = &cpus[cpu_num];
+    int level = p->level;
+    int first;
+
+    acquire(&c->head_lock);
+    first = atomic_load32(&c->first_runnable_proc[level]);
+    if (first == -1) {
+        release(&c->head_lock);
+        push_runnable(p, cpu_num);
+        return;
+    }
+    p->pinned = p->affinity == (1 << cpu_num);
+    if (p->pinned)
+        atomic_fetch_add32(&c->npinned, 1);
+    p->next_proc = first;
+    atomic_store32(&c->first_runnable_proc[level], p->index);
+    atomic_fetch_add32(&c->queue_len, 1);
+    release(&c->head_lock);
+
+    // the owner may have gone idle while p was off its queue.
+    __sync_synchronize();
+    if (atomic_load32(&c->idle))
+        send_ipi(cpu_num);
+}
+
+// Remove and return the index of the process at the head of
+// the given level of c's runnable queue, or -1 if it is empty.
+// O(1): only the head and, for the last element, the tail are touched.
+// Caller must hold c->head_lock.
+static int
+pop_level(struct cpu *c, int level)
+{
+    int first, next;
+
+    first = atomic_load32(&c->first_runnable_proc[level]);
+    if (first == -1)
+        return -1;
+    next = atomic_load32(&proc[first]->next_proc);
+    if (next == -1) {
+        // first may be the last element. Empty the head before
+        // swinging the tail back, since a producer that finds the
+        // tail empty will install itself as the new head.
+        atomic_store32(&c->first_runnable_proc[level], -1);
+        if (!atomic_cas32(&c->last_runnable_proc[level], first, -1)) {
+            // A producer already claimed the tail behind first;
+            // wait for it to publish the link.
+            while ((next = atomic_load32(&proc[first]->next_proc)) == -1)
+                ;
+            atomic_store32(&c->first_runnable_proc[level], next);
+        }
+    } else {
+        atomic_store32(&c->first_runnable_proc[level], next);
+    }
+    atomic_store32(&proc[first]->next_proc, -1);
+    return first;
+}
+
+// Remove and return the index of the next process to run from
+// cpu_num's runnable queues, or -1 if they are all empty.
+// Normally that is the head of the best non-empty level; after
+// balance_tick() asks for a boost, it is the head of the worst
+// one, which is moved back up to the best level it may use.
+int pop_runnable(int cpu_num) {
+    struct cpu *c = &cpus[cpu_num];
+    int level, index = -1;
+
+    if (atomic_load32(&c->queue_len) == 0)
+        return -1;
+
+    acquire(&c->head_lock);
+    if (atomic_load32(&c->boost)) {
+        atomic_store32(&c->boost, 0);
+        for (level = NLEVEL - 1; level > 0 && index == -1; level--)
+            index = pop_level(c, level);
+        if (index != -1)
+            proc[index]->level = min_level(proc[index]->nice);
+    }
+    for (level = 0; level < NLEVEL && index == -1; level++)
+        index = pop_level(c, level);
+    release(&c->head_lock);
+    if (index != -1) {
+        if (proc[index]->pinned)
+            atomic_fetch_add32(&c->npinned, -1);
+        atomic_fetch_add32(&c->queue_len, -1);
+    }
+    return index;
+}
+
+// Move up to n processes from the head of from's runnable
+// queue to the tail of to's, keeping processes_counter in step.
+// Processes whose affinity does not allow to are skipped: they
+// go back on the head of from's queue, in their old order, once
+// the others are moved. At most 2*n processes are looked at.
+// Returns the number of processes moved.
+static int
+migrate_runnable(int from, int to, int n)
+{
+    struct sched_class *sc = sched_class;
+    int moved = 0, tries = 2 * n;
+    int skipped = -1;   // list through next_proc, last skipped first
+    struct proc *p;
+
+    while (moved < n && tries-- > 0) {
+        int index = sc->dequeue(from);
+        if (index == -1)
+            break;
+        p = proc[index];
+        acquire(&p->lock);
+        if (cpu_allowed(p, to)) {
+            move_proc(p, to);
+            sc->enqueue(p, to);
+            moved++;
+        } else {
+            p->next_proc = skipped;
+            skipped = index;
+        }
+        release(&p->lock);
+    }
+
+    while (skipped != -1) {
+        p = proc[skipped];
+        acquire(&p->lock);
+        skipped = p->next_proc;
+        push_head(p, from);
+        release(&p->lock);
+    }
+    return moved;
+}
+
+// Called by an idle CPU. Take up to half of the runnable queue of
+// the most loaded peer, oldest processes first, and move them to
+// the thief's own queue. A peer with a single queued process is
+// only robbed while it is busy running something else.
+// Processes pinned to the peer do not count, and are left in
+// place: migrate_runnable() checks each one's affinity under
+// its lock as it takes it.
+// Returns the number of processes moved.
+int steal_runnable(int thief) {
+    int victim = -1;
+    int most = 0;
+    int i, len;
+
+    for (i = 0; i < NCPU; i++) {
+        if (i == thief || !is_cpu_online(i))
+            continue;
+        len = atomic_load32(&cpus[i].queue_len) - atomic_load32(&cpus[i].npinned);
+        if (len == 1 && cpus[i].proc == 0)
+            continue;
+        if (len > most) {
+            most = len;
+            victim = i;
+        }
+    }
+    if (victim == -1)
+        return 0;
+
+    return migrate_runnable(victim, thief, (most + 1) / 2);
+}
+
+// Called on every clock tick, from clockintr() on hart 0.
+// Folds each CPU's processes_counter into its load_avg, asks
+// for a priority boost every BOOST_TICKS, then runs the
+// scheduling policy's tick hook.
+void balance_tick(void) {
+    static int boost_countdown = BOOST_TICKS;
+    struct sched_class *sc = sched_class;
+    int i, boost, load;
+
+    boost = --boost_countdown == 0;
+    if (boost)
+        boost_countdown = BOOST_TICKS;
+
+    for (i = 0; i < NCPU; i++) {
+        struct cpu *c = &cpus[i];
+        if (!is_cpu_online(i))
+            continue;
+        // load_avg += (processes_counter - load_avg) / 8, in fixed point.
+        // Only hart 0 writes load_avg; any hart may read it.
+        load = atomic_load32(&c->load_avg);
+        load += (c->processes_counter * LOAD_SCALE - load) / 8;
+        atomic_store32(&c->load_avg, load);
+        if (boost)
+            atomic_store32(&c->boost, 1);
+    }
+
+    if (sc->tick)
+        sc->tick();
+}
+
+// The CPU in p's affinity mask with the fewest runnable and
+// running processes; ties go to the one with the lower recent
+// load, then to the current CPU.
+int choose_cpu(struct proc *p) {
+    int cpu = cpuid();
+    int i;
+
+    if (!cpu_allowed(p, cpu))
+        cpu = -1;
+    for (i = 0; i < NCPU; i++){
+        if (!cpu_allowed(p, i))
+            continue;
+        if (cpu == -1 || cpus[cpu].processes_counter > cpus[i].processes_counter ||
+            (cpus[cpu].processes_counter == cpus[i].processes_counter &&
+             atomic_load32(&cpus[i].load_avg) <
+             atomic_load32(&cpus[cpu].load_avg))){
             cpu = i;
         }
     }
-    return cpu;
+    return cpu == -1 ? p->num_of_cpu : cpu;
 }
 
+// Number of processes currently runnable or running on CPU num.
 int cpu_process_count(int num){
+  if (num < 0 || num >= NCPU)
+    return -1;
   struct cpu* cpu = &cpus[num];
   return cpu->processes_counter;
 }
+
+// Run the next process on cpu's queue, or, if the queue is
+// empty, steal from a busier CPU and run the first of those.
+static struct proc*
+fifo_pick_next(int cpu)
+{
+  int index = pop_runnable(cpu);
+  if (index < 0 && steal_runnable(cpu) > 0)
+    index = pop_runnable(cpu);
+  return index < 0 ? 0 : proc[index];
+}
+
+// SCHED_RR: a process stays where it is; a fork child starts
+// on its parent's CPU. Only idle CPUs move work, by stealing.
+static int
+rr_select_cpu(struct proc *p, int wakeup)
+{
+  if (cpu_allowed(p, p->num_of_cpu))
+    return p->num_of_cpu;
+  return choose_cpu(p);
+}
+
+// SCHED_LEAST: move queued processes from the busiest CPU to
+// the idlest one every REBALANCE_TICKS ticks.
+static void
+least_tick(void)
+{
+  static int countdown = REBALANCE_TICKS;
+  int busiest = -1, idlest = -1;
+  int load[NCPU];
+  int i, n;
+
+  if (--countdown > 0)
+    return;
+  countdown = REBALANCE_TICKS;
+
+  for (i = 0; i < NCPU; i++) {
+    if (!is_cpu_online(i))
+      continue;
+    load[i] = atomic_load32(&cpus[i].load_avg);
+    if (busiest == -1 || load[i] > load[busiest])
+      busiest = i;
+    if (idlest == -1 || load[i] < load[idlest])
+      idlest = i;
+  }
+  if (busiest == idlest)
+    return;
+
+  if (load[busiest] - load[idlest] <= REBALANCE_THRESHOLD)
+    return;
+  n = (cpus[busiest].processes_counter - cpus[idlest].processes_counter) / 2;
+  if (n > 0)
+    migrate_runnable(busiest, idlest, n);
+}
+
+// Wakeup placement for the balancing policies. best is the CPU
+// the policy picked for p. The CPU p last ran on, and then the
+// waker's, are likely to still have p's data in their caches,
+// so use one of those unless it is too much busier than best.
+static int
+wake_affine(struct proc *p, int best)
+{
+  int max = cpus[best].processes_counter + WAKE_IMBALANCE;
+  int prev = p->num_of_cpu;
+  int self = cpuid();
+
+  if (cpu_allowed(p, prev) && cpus[prev].processes_counter <= max)
+    return prev;
+  if (cpu_allowed(p, self) && cpus[self].processes_counter <= max)
+    return self;
+  return best;
+}
+
+static int
+least_select_cpu(struct proc *p, int wakeup)
+{
+  int cpu = choose_cpu(p);
+  return wakeup ? wake_affine(p, cpu) : cpu;
+}
+
+// SCHED_P2C: "power of two choices". Sample two online CPUs at
+// random and take the less loaded one. Close to choose_cpu()'s
+// balance, without every CPU reading every other CPU's counters.
+static uint p2c_seed[NCPU];
+
+static uint
+p2c_rand(void)
+{
+  // xorshift32. Interrupts are off, so cpuid() is stable.
+  uint *seed = &p2c_seed[cpuid()];
+  uint x = *seed;
+
+  if (x == 0)
+    x = 2463534242 + cpuid();
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return x;
+}
+
+static int
+p2c_select_cpu(struct proc *p, int wakeup)
+{
+  int online[NCPU];
+  int i, n = 0, a, b;
+
+  for (i = 0; i < NCPU; i++)
+    if (cpu_allowed(p, i))
+      online[n++] = i;
+  if (n == 0)
+    return p->num_of_cpu;
+
+  a = online[p2c_rand() % n];
+  b = online[p2c_rand() % n];
+  if (cpus[b].processes_counter < cpus[a].processes_counter ||
+      (cpus[b].processes_counter == cpus[a].processes_counter &&
+       atomic_load32(&cpus[b].load_avg) < atomic_load32(&cpus[a].load_avg)))
+    a = b;
+  return wakeup ? wake_affine(p, a) : a;
+}
+
+struct sched_class sched_classes[NSCHED] = {
+[SCHED_RR]    { "rr",    push_runnable, pop_runnable, fifo_pick_next, 0,          rr_select_cpu },
+[SCHED_LEAST] { "least", push_runnable, pop_runnable, fifo_pick_next, least_tick, least_select_cpu },
+[SCHED_P2C]   { "p2c",   push_runnable, pop_runnable, fifo_pick_next, 0,          p2c_select_cpu },
+};
+
+// The boot-time policy comes from BLNCFLG.
+#ifdef OFF
+struct sched_class *sched_class = &sched_classes[SCHED_RR];
+#else
+struct sched_class *sched_class = &sched_classes[SCHED_LEAST];
+#endif
+
+// Switch the scheduling policy for the whole system.
+// Returns the previous policy, or -1 if policy is not valid.
+int
+set_sched_policy(int policy)
+{
+  int old = get_sched_policy();
+
+  if (policy < 0 || policy >= NSCHED)
+    return -1;
+  sched_class = &sched_classes[policy];
+  return old;
+}
+
+int
+get_sched_policy(void)
+{
+  return sched_class - sched_classes;
+}
+
+// Set the nice value of process pid, or of the caller if pid is 0.
+// Returns 0, or -1 if there is no such process or nice is out of range.
+int
+setpriority(int pid, int nice)
+{
+  struct proc *p;
+
+  if (nice < NICE_MIN || nice > NICE_MAX)
+    return -1;
+  if (pid == 0) {
+    p = myproc();
+    acquire(&p->lock);
+  } else if ((p = findproc(pid)) == 0) {
+    return -1;
+  }
+  p->nice = nice;
+  if (p->level < min_level(nice))
+    p->level = min_level(nice);
+  release(&p->lock);
+  return 0;
+}
+
+// Copy the nice value of process pid, or of the caller if pid
+// is 0, to user address dst.
+// Returns 0, or -1 if there is no such process or dst is bad.
+int
+getpriority(int pid, uint64 dst)
+{
+  struct proc *p;
+  int nice;
+
+  if (pid == 0) {
+    p = myproc();
+    acquire(&p->lock);
+  } else if ((p = findproc(pid)) == 0) {
+    return -1;
+  }
+  nice = p->nice;
+  release(&p->lock);
+  if (copyout(myproc()->pagetable, dst, (char*)&nice, sizeof(nice)) < 0)
+    return -1;
+  return 0;
+}
+
+// Set the affinity mask of process pid, or of the caller if
+// pid is 0. Bit i allows CPU i. The mask must allow at least one
+// online CPU. A process running or queued on a CPU it no longer
+// allows is moved by the scheduler the next time it is picked;
+// the caller moves itself at once.
+// Returns 0, or -1 if there is no such process or mask is empty.
+int
+sched_setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+
+  mask &= ALL_CPUS;
+  if ((mask & cpus_online) == 0)
+    return -1;
+  if (pid == 0) {
+    p = myproc();
+    acquire(&p->lock);
+  } else if ((p = findproc(pid)) == 0) {
+    return -1;
+  }
+  p->affinity = mask;
+  if (p != myproc() || cpu_allowed(p, p->num_of_cpu)) {
+    release(&p->lock);
+    return 0;
+  }
+  move_proc(p, choose_cpu(p));
+  release(&p->lock);
+  yield();
+  return 0;
+}
+
+// The affinity mask of process pid, or of the caller if pid is 0.
+// Returns -1 if there is no such process.
+int
+sched_getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if (pid == 0) {
+    p = myproc();
+    acquire(&p->lock);
+  } else if ((p = findproc(pid)) == 0) {
+    return -1;
+  }
+  mask = p->affinity;
+  release(&p->lock);
+  return mask;
+}
+
+// Copy a struct procinfo for each of up to n processes to
+// user address dst. Returns the number of processes copied,
+// or -1.
+int
+getprocinfo(uint64 dst, int n)
+{
+  struct proc *p;
+  struct procinfo pi;
+  int i, copied = 0;
+  int nslot = atomic_load32(&nslots);
+
+  for(i = 0; i < nslot && copied < n; i++){
+    p = proc[i];
+    acquire(&p->lock);
+    if(p->state == UNUSED){
+      release(&p->lock);
+      continue;
+    }
+    pi.pid = p->pid;
+    pi.state = p->state;
+    pi.cpu = p->last_cpu;
+    pi.level = p->level;
+    pi.nice = p->nice;
+    pi.utime = p->utime;
+    pi.stime = p->stime;
+    pi.wtime = p->wtime;
+    pi.nvcsw = p->nvcsw;
+    pi.nivcsw = p->nivcsw;
+    safestrcpy(pi.name, p->name, sizeof(pi.name));
+    release(&p->lock);
+
+    if(copyout(myproc()->pagetable, dst, (char*)&pi, sizeof(pi)) < 0)
+      return -1;
+    dst += sizeof(pi);
+    copied++;
+  }
+  return copied;
+}
+
+// Copy a struct cpuinfo for each of the first n CPUs to
+// user address dst. Returns the number of CPUs copied, or -1.
+int
+getcpuinfo(uint64 dst, int n)
+{
+  struct cpuinfo ci;
+  int i;
+
+  if(n < 0)
+    return -1;
+  if(n > NCPU)
+    n = NCPU;
+  for(i = 0; i < n; i++){
+    ci.online = is_cpu_online(i);
+    ci.nproc = cpus[i].processes_counter;
+    ci.busy = cpus[i].busy;
+    if(copyout(myproc()->pagetable, dst, (char*)&ci, sizeof(ci)) < 0)
+      return -1;
+    dst += sizeof(ci);
+  }
+  return n;
+}
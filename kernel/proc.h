@@ -18,18 +18,51 @@ struct context {
   uint64 s11;
 };
 
+// Runnable queues are split into NLEVEL priority levels.
+// Level 0 is run first and has the shortest time slice.
+#define NLEVEL 3
+
 // Per-CPU state.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
   struct context context;     // swtch() here to enter scheduler().
-  struct spinlock head_lock;
+  struct spinlock head_lock;  // serializes pop_runnable(); pushes are lock-free.
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
 
-  int first_runnable_proc;
-  volatile uint64 processes_counter;
+  volatile int first_runnable_proc[NLEVEL]; // head of each level's queue, -1 if empty.
+  volatile int last_runnable_proc[NLEVEL];  // tails, claimed by producers with atomic_xchg32().
+  volatile int queue_len;           // number of processes on the runnable queues.
+  volatile int npinned;             // how many of those may run nowhere else.
+  volatile int need_resched;        // a process better than the running one was queued.
+  volatile int boost;               // next pop serves the lowest non-empty level.
+  volatile int idle;                // in wfi; push_runnable() must send_ipi().
+  volatile int processes_counter;   // runnable or running processes assigned here.
+  volatile int load_avg;            // decayed processes_counter, scaled by LOAD_SCALE.
+  uint64 busy;                      // time spent running processes, see r_time().
+  int tlb_gen;                      // kstack_gen at this hart's last sfence_vma().
 };
 
+#define ALL_CPUS ((1 << NCPU) - 1)
+
+#define LOAD_SHIFT 10
+#define LOAD_SCALE (1 << LOAD_SHIFT)
+
+struct proc;
+
+// A scheduling policy. All policies share the per-CPU runnable
+// queues, so the policy can be switched while processes are queued.
+struct sched_class {
+  char *name;
+  void (*enqueue)(struct proc *p, int cpu);       // queue p, RUNNABLE, on cpu
+  int (*dequeue)(int cpu);                        // take a queued process off cpu, for migration
+  struct proc *(*pick_next)(int cpu);             // next process for cpu to run, or 0
+  void (*tick)(void);                             // every clock tick on hart 0; may be 0
+  int (*select_cpu)(struct proc *p, int wakeup);  // CPU for a new, moved or (wakeup) woken p
+};
+
+extern struct sched_class *sched_class;
+
 extern struct cpu cpus[NCPU];
 
 // per-process data for the trap handling code in trampoline.S.
@@ -86,6 +119,19 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A loadable segment of the program a process runs. exec()
+// only records it; lazyfault() reads each page in from the
+// program's inode when it is first touched.
+#define NSEG 4
+
+struct segment {
+  uint64 va;      // page-aligned start
+  uint64 memsz;   // bytes in memory
+  uint off;       // file offset of va
+  uint filesz;    // bytes from the file; the rest are zero
+  int perm;       // PTE_R, PTE_W, PTE_X for its pages
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -97,20 +143,54 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  struct proc *pid_next;       // Next in pid hash bucket
   volatile int num_of_cpu;
   volatile int next_proc;
   int index;
+  int nice;                    // -20 (most favoured) to 19
+  uint affinity;               // CPUs p may run on, bit i for CPU i
+  int level;                   // runnable queue level, see NLEVEL
+  int pinned;                  // counted in its queue's npinned
+  int slice_ticks;             // ticks used of the current time slice
+  int preempt_count;           // see preempt_disable(); private to p
 
-  // wait_lock must be held when using this:
+  // accounting, in time CSR units; see account().
+  uint64 stamp;                // when the time below was last charged
+  uint64 utime;                // running in user space
+  uint64 stime;                // running in the kernel
+  uint64 wtime;                // runnable, waiting for a CPU
+  int nvcsw;                   // gave up the CPU to sleep
+  int nivcsw;                  // preempted, or yielded
+  int last_cpu;                // CPU it last ran on
+
+  // parent->wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *next_sibling;   // Parent's list of children
+  struct proc *prev_sibling;
+  struct proc *next_zombie;    // Parent's list of exited children
+
+  // helps ensure that wakeups of wait()ing
+  // parents are not lost. helps obey the
+  // memory model when using p->parent.
+  // must be acquired before any p->lock,
+  // and a child's before its parent's.
+  struct spinlock wait_lock;
+
+  // wait_lock must be held when using these:
+  struct proc *first_child;    // Children, exited or not
+  struct proc *first_zombie;   // Exited children not yet waited for
 
   // these are private to the process, so p->lock need not be held.
-  uint64 kstack;               // Virtual address of kernel stack
+  uint64 kstack;               // Virtual address of kernel stack, or 0
+  int kstack_gen;              // kstack_gen when it was mapped
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct inode *exe;           // Program, paged in on demand
+  struct segment seg[NSEG];    // exe's loadable segments
+  int nseg;
   char name[16];               // Process name (debugging)
 };
@@ -0,0 +1,21 @@
+// Process and CPU statistics, as returned by getprocinfo()
+// and getcpuinfo(). Times are in mtime cycles, MTIME_HZ a second.
+struct procinfo {
+  int pid;
+  int state;      // enum procstate
+  int cpu;        // CPU it last ran on, -1 if none yet
+  int level;      // runnable queue level
+  int nice;
+  int nvcsw;      // gave up the CPU to sleep
+  int nivcsw;     // preempted, or yielded
+  uint64 utime;   // running in user space
+  uint64 stime;   // running in the kernel
+  uint64 wtime;   // runnable, waiting for a CPU
+  char name[16];
+};
+
+struct cpuinfo {
+  int online;
+  int nproc;      // runnable or running processes assigned to it
+  uint64 busy;    // running processes
+};
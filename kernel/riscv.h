@@ -246,6 +246,7 @@ r_stval()
 }
 
 // Machine-mode Counter-Enable
+#define COUNTEREN_TM (1L << 1) // time CSR
 static inline void 
 w_mcounteren(uint64 x)
 {
@@ -260,6 +261,21 @@ r_mcounteren()
   return x;
 }
 
+// Supervisor-mode Counter-Enable
+static inline void 
+w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
+static inline uint64
+r_scounteren()
+{
+  uint64 x;
+  asm volatile("csrr %0, scounteren" : "=r" (x) );
+  return x;
+}
+
 // machine-mode cycle counter
 static inline uint64
 r_time()
@@ -323,6 +339,13 @@ r_ra()
   return x;
 }
 
+// stall the hart until an interrupt is pending.
+static inline void
+wfi()
+{
+  asm volatile("wfi");
+}
+
 // flush the TLB.
 static inline void
 sfence_vma()
@@ -343,6 +366,7 @@ sfence_vma()
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
+#define PTE_COW (1L << 8) // copy-on-write: shared, W cleared until a store (RSW bit)
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
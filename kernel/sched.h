@@ -0,0 +1,9 @@
+// Scheduling policies, for set_sched_policy().
+#define SCHED_RR      0  // processes stay on the CPU they were created or woken on
+#define SCHED_LEAST   1  // place on the least loaded CPU, rebalance periodically
+#define SCHED_P2C     2  // place on the less loaded of two random CPUs
+#define NSCHED        3
+
+// Nice values, for setpriority() and getpriority().
+#define NICE_MIN    -20
+#define NICE_MAX     19
@@ -1,19 +1,129 @@
 // Mutual exclusion spin locks.
 
 #include "types.h"
+#include "atomic.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "lockstat.h"
+
+#ifdef LOCKSTAT
+// Statistics are kept per name, so all the locks given the
+// same name, such as every process's "proc" lock, share an
+// entry. Locks sharing an entry can be held at once, so the
+// counters are updated with atomic adds. statlock guards the
+// adding of entries; it cannot be a struct spinlock.
+static struct lockstat stats[NLOCKSTAT];
+static int nstats;
+static uint statlock;
+
+static struct lockstat*
+findstat(char *name)
+{
+  struct lockstat *s = 0;
+  int i;
+
+  push_off();
+  while(__sync_lock_test_and_set(&statlock, 1) != 0)
+    ;
+  for(i = 0; i < nstats; i++)
+    if(strncmp(stats[i].name, name, sizeof(stats[i].name) - 1) == 0)
+      s = &stats[i];
+  if(s == 0 && nstats < NLOCKSTAT){
+    s = &stats[nstats];
+    safestrcpy(s->name, name, sizeof(s->name));
+    __sync_synchronize();
+    nstats++;
+  }
+  __sync_lock_release(&statlock);
+  pop_off();
+  return s;
+}
+
+static void
+lockstat_acquired(struct spinlock *lk, uint64 spins)
+{
+  struct lockstat *s = lk->stat;
+
+  lk->start = r_time();
+  if(s == 0)
+    return;
+  atomic_fetch_add64(&s->acquire, 1);
+  if(spins){
+    atomic_fetch_add64(&s->contended, 1);
+    atomic_fetch_add64(&s->spins, spins);
+  }
+}
+
+static void
+lockstat_released(struct spinlock *lk)
+{
+  struct lockstat *s = lk->stat;
+  uint64 t, max;
+
+  if(s == 0)
+    return;
+  t = r_time() - lk->start;
+  atomic_fetch_add64(&s->hold, t);
+  while((max = atomic_load64(&s->maxhold)) < t &&
+        !atomic_cas64(&s->maxhold, max, t))
+    ;
+}
+
+// Copy the statistics of up to n lock names to user address
+// dst, and then clear the counters if reset is set. Returns
+// the number of entries copied, or -1.
+int
+lockstat(uint64 dst, int n, int reset)
+{
+  int i;
+
+  if(n < 0)
+    return -1;
+  if(n > nstats)
+    n = nstats;
+  if(copyout(myproc()->pagetable, dst, (char*)stats, n * sizeof(stats[0])) < 0)
+    return -1;
+  if(reset){
+    // Other CPUs may be updating the counters meanwhile.
+    for(i = 0; i < nstats; i++){
+      atomic_store64(&stats[i].acquire, 0);
+      atomic_store64(&stats[i].contended, 0);
+      atomic_store64(&stats[i].spins, 0);
+      atomic_store64(&stats[i].hold, 0);
+      atomic_store64(&stats[i].maxhold, 0);
+    }
+  }
+  return n;
+}
+#else
+static inline void lockstat_acquired(struct spinlock *lk, uint64 spins) {}
+static inline void lockstat_released(struct spinlock *lk) {}
+
+int
+lockstat(uint64 dst, int n, int reset)
+{
+  return -1;
+}
+#endif
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
+#ifdef LOCK_TAS
   lk->locked = 0;
+#else
+  lk->next = 0;
+  lk->owner = 0;
+#endif
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lk->stat = findstat(name);
+#endif
 }
 
 // Acquire the lock.
@@ -21,16 +131,27 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 spins = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+#ifdef LOCK_TAS
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+    spins++;
+#else
+  // Take a ticket with an atomic add, amoadd.w, and wait for
+  // release() to advance owner to it. The wait only reads
+  // owner, so it does not steal the line from the holder.
+  uint ticket = __sync_fetch_and_add(&lk->next, 1);
+  while(__atomic_load_n(&lk->owner, __ATOMIC_RELAXED) != ticket)
+    spins++;
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +161,7 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  lockstat_acquired(lk, spins);
 }
 
 // Release the lock.
@@ -49,6 +171,7 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  lockstat_released(lk);
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,6 +182,7 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#ifdef LOCK_TAS
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -67,6 +191,11 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#else
+  // Serve the next ticket. Only the holder writes owner, so a
+  // plain load is enough; the store must be a single one.
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELAXED);
+#endif
 
   pop_off();
 }
@@ -77,7 +206,11 @@ int
 holding(struct spinlock *lk)
 {
   int r;
+#ifdef LOCK_TAS
   r = (lk->locked && lk->cpu == mycpu());
+#else
+  r = (lk->owner != lk->next && lk->cpu == mycpu());
+#endif
   return r;
 }
 
@@ -1,9 +1,24 @@
 // Mutual exclusion lock.
+//
+// Built as a ticket lock unless LOCK_TAS is defined (make
+// LOCK=TAS). A ticket lock hands the lock to waiters in the
+// order they arrived, and waiters spin reading owner, so the
+// one write per handoff is the only cache line traffic.
+// The test-and-set lock has every waiter swap on locked.
 struct spinlock {
+#ifdef LOCK_TAS
   uint locked;       // Is the lock held?
+#else
+  uint next;         // Next ticket to hand out.
+  uint owner;        // Ticket being served; held if != next.
+#endif
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
-};
 
+#ifdef LOCKSTAT
+  struct lockstat *stat;  // Statistics for name, or 0.
+  uint64 start;           // When it was acquired.
+#endif
+};
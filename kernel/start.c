@@ -11,7 +11,7 @@ void timerinit();
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
 // a scratch area per CPU for machine-mode timer interrupts.
-uint64 timer_scratch[NCPU][5];
+uint64 timer_scratch[NCPU][6];
 
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
@@ -46,6 +46,11 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // let supervisor and user mode read the time CSR,
+  // for r_time() and rdtime().
+  w_mcounteren(r_mcounteren() | COUNTEREN_TM);
+  w_scounteren(r_scounteren() | COUNTEREN_TM);
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -64,17 +69,20 @@ timerinit()
   // each CPU has a separate source of timer interrupts.
   int id = r_mhartid();
 
-  // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
-  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
+  // ask the CLINT for a timer interrupt, at the next multiple
+  // of interval, so that ticks can be counted from mtime.
+  int interval = TICK_INTERVAL; // cycles; 1/HZ seconds in qemu.
+  *(uint64*)CLINT_MTIMECMP(id) = (*(uint64*)CLINT_MTIME / interval + 1) * interval;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..2] : space for timervec to save registers.
   // scratch[3] : address of CLINT MTIMECMP register.
   // scratch[4] : desired interval (in cycles) between timer interrupts.
+  // scratch[5] : set by timervec on a timer tick, cleared by devintr().
   uint64 *scratch = &timer_scratch[id][0];
   scratch[3] = CLINT_MTIMECMP(id);
   scratch[4] = interval;
+  scratch[5] = 0;
   w_mscratch((uint64)scratch);
 
   // set the machine-mode trap handler.
@@ -83,6 +91,7 @@ timerinit()
   // enable machine-mode interrupts.
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
-  // enable machine-mode timer interrupts.
-  w_mie(r_mie() | MIE_MTIE);
+  // enable machine-mode timer interrupts, and software
+  // interrupts for reschedule IPIs from other harts.
+  w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
 }
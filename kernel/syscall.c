@@ -107,6 +107,19 @@ extern uint64 sys_uptime(void);
 extern uint64 sys_set_cpu(void);
 extern uint64 sys_get_cpu(void);
 extern uint64 sys_cpu_process_count(void);
+extern uint64 sys_set_sched_policy(void);
+extern uint64 sys_get_sched_policy(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_getpriority(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_trace_read(void);
+extern uint64 sys_getprocinfo(void);
+extern uint64 sys_getcpuinfo(void);
+extern uint64 sys_lockbench(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_sched_yield(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -133,6 +146,19 @@ static uint64 (*syscalls[])(void) = {
 [SYS_set_cpu]   sys_set_cpu,
 [SYS_get_cpu]   sys_get_cpu,
 [SYS_cpu_process_count]   sys_cpu_process_count,
+[SYS_set_sched_policy]   sys_set_sched_policy,
+[SYS_get_sched_policy]   sys_get_sched_policy,
+[SYS_setpriority]   sys_setpriority,
+[SYS_getpriority]   sys_getpriority,
+[SYS_sched_setaffinity]   sys_sched_setaffinity,
+[SYS_sched_getaffinity]   sys_sched_getaffinity,
+[SYS_nanosleep]   sys_nanosleep,
+[SYS_trace_read]   sys_trace_read,
+[SYS_getprocinfo]   sys_getprocinfo,
+[SYS_getcpuinfo]   sys_getcpuinfo,
+[SYS_lockbench]   sys_lockbench,
+[SYS_lockstat]   sys_lockstat,
+[SYS_sched_yield]   sys_sched_yield,
 };
 
 void
@@ -22,4 +22,17 @@
 #define SYS_close  21
 #define SYS_set_cpu  22
 #define SYS_get_cpu  23
-#define SYS_cpu_process_count  24
\ No newline at end of file
+#define SYS_cpu_process_count  24
+#define SYS_set_sched_policy  25
+#define SYS_get_sched_policy  26
+#define SYS_setpriority  27
+#define SYS_getpriority  28
+#define SYS_sched_setaffinity  29
+#define SYS_sched_getaffinity  30
+#define SYS_nanosleep  31
+#define SYS_trace_read  32
+#define SYS_getprocinfo  33
+#define SYS_getcpuinfo  34
+#define SYS_lockbench  35
+#define SYS_lockstat  36
+#define SYS_sched_yield  37
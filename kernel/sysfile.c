@@ -322,6 +322,13 @@ sys_open(void)
     return -1;
   }
 
+  // itrunc() refuses a running program's file.
+  if((omode & O_TRUNC) && ip->type == T_FILE && itrunc(ip) < 0){
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
+
   if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
     if(f)
       fileclose(f);
@@ -341,10 +348,6 @@ sys_open(void)
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
 
-  if((omode & O_TRUNC) && ip->type == T_FILE){
-    itrunc(ip);
-  }
-
   iunlock(ip);
   end_op();
 
@@ -56,21 +56,22 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n <= 0)
+    return 0;
+  return timer_sleep(n);
+}
+
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns;
+
+  if(argaddr(0, &ns) < 0)
+    return -1;
+  return nanosleep(ns);
 }
 
 uint64
@@ -91,6 +92,7 @@ sys_uptime(void)
   uint xticks;
 
   acquire(&tickslock);
+  ticks_update();
   xticks = ticks;
   release(&tickslock);
   return xticks;
@@ -120,4 +122,125 @@ sys_cpu_process_count(void)
       return cpu_process_count(num);
 
     return -1;
-}
\ No newline at end of file
+}
+
+uint64
+sys_set_sched_policy(void)
+{
+    int policy;
+    if(argint(0, &policy) >= 0)
+      return set_sched_policy(policy);
+
+    return -1;
+}
+
+uint64
+sys_get_sched_policy(void)
+{
+    return get_sched_policy();
+}
+
+uint64
+sys_setpriority(void)
+{
+    int pid, nice;
+    if(argint(0, &pid) >= 0 && argint(1, &nice) >= 0)
+      return setpriority(pid, nice);
+
+    return -1;
+}
+
+uint64
+sys_getpriority(void)
+{
+    int pid;
+    uint64 dst;
+    if(argint(0, &pid) >= 0 && argaddr(1, &dst) >= 0)
+      return getpriority(pid, dst);
+
+    return -1;
+}
+
+uint64
+sys_sched_setaffinity(void)
+{
+    int pid, mask;
+    if(argint(0, &pid) >= 0 && argint(1, &mask) >= 0)
+      return sched_setaffinity(pid, mask);
+
+    return -1;
+}
+
+uint64
+sys_sched_getaffinity(void)
+{
+    int pid;
+    if(argint(0, &pid) >= 0)
+      return sched_getaffinity(pid);
+
+    return -1;
+}
+
+// Give up the CPU, staying runnable, with no change to
+// the caller's affinity.
+uint64
+sys_sched_yield(void)
+{
+    yield();
+    return 0;
+}
+
+uint64
+sys_trace_read(void)
+{
+    int cpu, n;
+    uint64 dst;
+    if(argint(0, &cpu) >= 0 && argaddr(1, &dst) >= 0 && argint(2, &n) >= 0)
+      return trace_read(cpu, dst, n);
+
+    return -1;
+}
+
+uint64
+sys_getprocinfo(void)
+{
+    int n;
+    uint64 dst;
+    if(argaddr(0, &dst) >= 0 && argint(1, &n) >= 0)
+      return getprocinfo(dst, n);
+
+    return -1;
+}
+
+uint64
+sys_getcpuinfo(void)
+{
+    int n;
+    uint64 dst;
+    if(argaddr(0, &dst) >= 0 && argint(1, &n) >= 0)
+      return getcpuinfo(dst, n);
+
+    return -1;
+}
+
+uint64
+sys_lockbench(void)
+{
+    int n;
+    uint64 dst;
+    if(argint(0, &n) >= 0 && argaddr(1, &dst) >= 0)
+      return lockbench(n, dst);
+
+    return -1;
+}
+
+uint64
+sys_lockstat(void)
+{
+    int n, reset;
+    uint64 dst;
+    if(argaddr(0, &dst) >= 0 && argint(1, &n) >= 0 && argint(2, &reset) >= 0)
+      return lockstat(dst, n, reset);
+
+    return -1;
+}
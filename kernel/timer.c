@@ -0,0 +1,301 @@
+// Timers for sleeping processes.
+//
+// A hierarchical timer wheel, as in older Linux kernels.
+// Level 0 has one slot per tick for the next 64 ticks, level 1
+// one slot per 64 ticks for the next 4096, and so on. A timer is
+// put in the finest level that reaches its deadline. Whenever
+// level 0 wraps around, the next slot of level 1 is cascaded:
+// its timers are re-added, which moves them down a level, and
+// likewise for higher levels. Each tick only touches the timers
+// that expire then, plus an occasional cascade, so the cost does
+// not grow with the number of sleeping processes.
+//
+// nanosleep() uses the wheel to get within a tick of its
+// deadline, then a high-resolution timer for the rest: hart 0's
+// CLINT timer is set for the deadline itself, see clockintr().
+//
+// The wheel and the high-resolution timers are protected by
+// tickslock. The wheel is run by ticks_update().
+
+#include "types.h"
+#include "atomic.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define WHEEL_BITS  6
+#define WHEEL_SIZE  (1 << WHEEL_BITS)
+#define WHEEL_MASK  (WHEEL_SIZE - 1)
+#define NWHEEL      4
+#define WHEEL_MAX   ((1 << (WHEEL_BITS * NWHEEL)) - 1)  // longest timer, in ticks
+
+struct timer {
+  uint expires;           // tick to fire at
+  struct timer *next;
+  struct timer **pprev;   // link that points here; 0 if not on the wheel
+};
+
+struct timer *wheel[NWHEEL][WHEEL_SIZE];
+
+// the last tick the wheel has run.
+uint wheel_now;
+
+// Put t on the wheel to fire at tick t->expires.
+// Caller must hold tickslock.
+static void
+timer_add(struct timer *t)
+{
+  uint delta = t->expires - wheel_now;
+  struct timer **slot;
+  int level;
+
+  if((int)delta < 0){
+    // already due: fire with the current slot.
+    t->expires = wheel_now;
+    delta = 0;
+  } else if(delta > WHEEL_MAX){
+    // fire early; timer_sleep() will re-arm it.
+    t->expires = wheel_now + WHEEL_MAX;
+    delta = WHEEL_MAX;
+  }
+
+  for(level = 0; level < NWHEEL - 1; level++)
+    if(delta < (1 << (WHEEL_BITS * (level + 1))))
+      break;
+  slot = &wheel[level][(t->expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+
+  t->next = *slot;
+  if(t->next)
+    t->next->pprev = &t->next;
+  t->pprev = slot;
+  *slot = t;
+}
+
+// Take t off the wheel, if it is still there.
+// Caller must hold tickslock.
+static void
+timer_del(struct timer *t)
+{
+  if(t->pprev == 0)
+    return;
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->next = 0;
+  t->pprev = 0;
+}
+
+// Re-add every timer in wheel[level][index], which moves
+// them down to finer levels. Returns index, so that the
+// caller knows when this level has wrapped too.
+static int
+cascade(int level, int index)
+{
+  struct timer *t, *next;
+
+  t = wheel[level][index];
+  wheel[level][index] = 0;
+  for(; t; t = next){
+    next = t->next;
+    timer_add(t);
+  }
+  return index;
+}
+
+// Advance the wheel to tick now, waking the processes whose
+// timers expire. Called from ticks_update() with tickslock held.
+void
+timer_tick(uint now)
+{
+  struct timer *t;
+  int index, level;
+
+  while(wheel_now != now){
+    wheel_now++;
+    index = wheel_now & WHEEL_MASK;
+    for(level = 1; index == 0 && level < NWHEEL; level++)
+      index = cascade(level, (wheel_now >> (WHEEL_BITS * level)) & WHEEL_MASK);
+
+    while((t = wheel[0][wheel_now & WHEEL_MASK]) != 0){
+      timer_del(t);
+      wakeup(t);
+    }
+  }
+}
+
+// Set *when to the first tick at which the wheel has work to
+// do: a level 0 timer expiring, or a cascade of higher levels.
+// Returns 0 if there are no timers at all.
+// Caller must hold tickslock.
+int
+timer_next(uint *when)
+{
+  int level, i, wrap;
+
+  // ticks until level 0 next wraps around.
+  wrap = WHEEL_SIZE - (wheel_now & WHEEL_MASK);
+  for(i = 1; i < wrap; i++){
+    if(wheel[0][(wheel_now + i) & WHEEL_MASK]){
+      *when = wheel_now + i;
+      return 1;
+    }
+  }
+  for(level = 0; level < NWHEEL; level++){
+    for(i = 0; i < WHEEL_SIZE; i++){
+      if(wheel[level][i]){
+        *when = wheel_now + wrap;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Sleep for n ticks.
+// Returns 0, or -1 if the process was killed first.
+int
+timer_sleep(uint n)
+{
+  struct proc *p = myproc();
+  struct timer t;
+  uint deadline;
+
+  t.pprev = 0;
+  acquire(&tickslock);
+  ticks_update();
+  deadline = ticks + n;
+  while((int)(ticks - deadline) < 0){
+    if(p->killed){
+      release(&tickslock);
+      return -1;
+    }
+    t.expires = deadline;
+    timer_add(&t);
+    // hart 0 may be idle, with its timer set
+    // for a later deadline or none at all.
+    if(atomic_load32(&cpus[0].idle))
+      send_ipi(0);
+    while(t.pprev && !p->killed)
+      sleep(&t, &tickslock);
+    timer_del(&t);
+  }
+  release(&tickslock);
+  return 0;
+}
+
+// High-resolution timers, for deadlines less than a tick away.
+// Kept on a list sorted by deadline, which stays short: the
+// wheel holds each nanosleep() until its last tick.
+struct hrtimer {
+  uint64 expires;         // mtime to fire at
+  struct hrtimer *next;
+  int pending;            // on the list
+};
+
+struct hrtimer *hrtimers;
+
+// Put t on the list to fire at mtime t->expires. If it is the
+// first now, have hart 0 set its timer for it.
+// Caller must hold tickslock.
+static void
+hrtimer_add(struct hrtimer *t)
+{
+  struct hrtimer **pp;
+
+  for(pp = &hrtimers; *pp && (*pp)->expires <= t->expires; pp = &(*pp)->next)
+    ;
+  t->next = *pp;
+  *pp = t;
+  t->pending = 1;
+  if(hrtimers == t)
+    clock_rearm();
+}
+
+// Take t off the list, if it is still there.
+// Caller must hold tickslock.
+static void
+hrtimer_del(struct hrtimer *t)
+{
+  struct hrtimer **pp;
+
+  if(!t->pending)
+    return;
+  for(pp = &hrtimers; *pp != t; pp = &(*pp)->next)
+    ;
+  *pp = t->next;
+  t->pending = 0;
+}
+
+// Wake the processes whose high-resolution timers are due at
+// mtime now. Called from clockintr() with tickslock held.
+void
+hrtimer_run(uint64 now)
+{
+  struct hrtimer *t;
+
+  while((t = hrtimers) != 0 && t->expires <= now){
+    hrtimer_del(t);
+    wakeup(t);
+  }
+}
+
+// Set *when to the mtime of the first high-resolution timer.
+// Returns 0 if there are none.
+// Caller must hold tickslock.
+int
+hrtimer_next(uint64 *when)
+{
+  if(hrtimers == 0)
+    return 0;
+  *when = hrtimers->expires;
+  return 1;
+}
+
+// Sleep for ns nanoseconds, measured with the CLINT's mtime
+// counter: on the wheel while the deadline is more than a tick
+// away, then on a high-resolution timer. It never returns early.
+// Returns 0, or -1 if the process was killed first.
+int
+nanosleep(uint64 ns)
+{
+  struct proc *p = myproc();
+  struct hrtimer t;
+  uint64 cycle = 1000000000 / MTIME_HZ;  // ns per mtime cycle
+  uint64 n = ns / cycle + (ns % cycle != 0);
+  uint64 end, now;
+
+  // A deadline past the end of mtime saturates, and is
+  // never reached, rather than wrapping into the past.
+  now = r_time();
+  end = n > (uint64)-1 - now ? (uint64)-1 : now + n;
+
+  // The wheel fires at tick boundaries, so n whole ticks
+  // from now cannot take it past end. timer_sleep()'s
+  // deadline is a uint, so sleep at most 2^30 ticks at once.
+  while((now = r_time()) + TICK_INTERVAL < end){
+    n = (end - now) / TICK_INTERVAL;
+    if(n > (1 << 30))
+      n = 1 << 30;
+    if(timer_sleep(n) < 0)
+      return -1;
+  }
+
+  t.expires = end;
+  t.pending = 0;
+  acquire(&tickslock);
+  while(r_time() < end){
+    if(p->killed){
+      release(&tickslock);
+      return -1;
+    }
+    hrtimer_add(&t);
+    while(t.pending && !p->killed)
+      sleep(&t, &tickslock);
+    hrtimer_del(&t);
+  }
+  release(&tickslock);
+  return 0;
+}
@@ -0,0 +1,68 @@
+// Scheduler event tracing.
+//
+// Each CPU records its events in a ring of its own, with
+// interrupts off, so a ring has a single writer and needs no
+// lock. head counts the events ever written; event i lives in
+// ev[i % NTRACE] until event i + NTRACE overwrites it. Readers
+// copy an event out, then check that head has not moved far
+// enough for the writer to have started on that slot again.
+
+#include "types.h"
+#include "atomic.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "trace.h"
+
+struct {
+  volatile uint64 head;
+  struct trace_event ev[NTRACE];
+} rings[NCPU];
+
+void
+trace(int type, int pid, int cpu, int arg)
+{
+  push_off();
+  volatile uint64 *head = &rings[cpuid()].head;
+  uint64 i = *head;
+  struct trace_event *e = &rings[cpuid()].ev[i % NTRACE];
+
+  e->time = r_time();
+  e->type = type;
+  e->pid = pid;
+  e->cpu = cpu;
+  e->arg = arg;
+  atomic_store64(head, i + 1);
+  pop_off();
+}
+
+// Copy up to n of the latest events recorded by CPU cpu, oldest
+// first, to user address dst. Returns the number of events
+// copied, or -1.
+int
+trace_read(int cpu, uint64 dst, int n)
+{
+  struct trace_event e;
+  uint64 head, i;
+  int copied = 0;
+
+  if(cpu < 0 || cpu >= NCPU || n < 0)
+    return -1;
+
+  head = atomic_load64(&rings[cpu].head);
+  i = head > n ? head - n : 0;
+  for(; i < head; i++){
+    e = rings[cpu].ev[i % NTRACE];
+    __sync_synchronize();
+    if(atomic_load64(&rings[cpu].head) - i >= NTRACE)
+      continue;  // overwritten, or being overwritten
+    if(copyout(myproc()->pagetable, dst, (char*)&e, sizeof(e)) < 0)
+      return -1;
+    dst += sizeof(e);
+    copied++;
+  }
+  return copied;
+}
@@ -0,0 +1,18 @@
+// Scheduler trace events, as returned by trace_read().
+struct trace_event {
+  uint64 time;  // mtime cycles since boot
+  int type;     // TRACE_*
+  int pid;
+  int cpu;      // see below
+  int arg;      // see below
+};
+
+//                          cpu                  arg
+#define TRACE_SWITCH_IN  1  // where it runs      queue level
+#define TRACE_SWITCH_OUT 2  // where it ran       new state (enum procstate)
+#define TRACE_WAKEUP     3  // queued on          the waker's cpu
+#define TRACE_MIGRATE    4  // moved to           moved from
+#define TRACE_FORK       5  // child queued on    child's pid
+#define TRACE_EXIT       6  // where it ran       exit status
+
+#define NTRACE 1024  // events kept per CPU
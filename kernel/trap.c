@@ -1,4 +1,5 @@
 #include "types.h"
+#include "atomic.h"
 #include "param.h"
 #include "memlayout.h"
 #include "riscv.h"
@@ -9,6 +10,16 @@
 struct spinlock tickslock;
 uint ticks;
 
+// ticks counts whole TICK_INTERVALs of mtime since boot,
+// which started at mtime tick tick_base.
+static uint64 tick_base;
+
+// Set while hart 0 is idle without its periodic tick.
+// balance_tick() runs only on hart 0's ticks, so hart 0
+// stops ticking only while every other hart is idle too,
+// and a hart that stops idling wakes it; see tick_stop().
+static volatile int clock_stopped;
+
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
@@ -16,10 +27,14 @@ void kernelvec();
 
 extern int devintr();
 
+// in start.c; timer_scratch[hart][5] is set by timervec on a tick.
+extern uint64 timer_scratch[NCPU][6];
+
 void
 trapinit(void)
 {
   initlock(&tickslock, "time");
+  tick_base = r_time() / TICK_INTERVAL;
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -46,6 +61,7 @@ usertrap(void)
   w_stvec((uint64)kernelvec);
 
   struct proc *p = myproc();
+  account(p, &p->utime);
   
   // save user program counter.
   p->trapframe->epc = r_sepc();
@@ -67,6 +83,11 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(r_scause() == 15 && cowfault(p->pagetable, r_stval()) == 0){
+    // store to a copy-on-write page
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            lazyfault(p, r_stval()) == 0){
+    // first touch of a page of the program or the heap
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -76,9 +97,9 @@ usertrap(void)
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
-    yield();
+  // give up the CPU if the time slice is used up,
+  // or a better process was woken on this CPU.
+  timeslice(which_dev == 2);
 
   usertrapret();
 }
@@ -121,6 +142,8 @@ usertrapret(void)
   // tell trampoline.S the user page table to switch to.
   uint64 satp = MAKE_SATP(p->pagetable);
 
+  account(p, &p->stime);
+
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
@@ -149,9 +172,10 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    yield();
+  // give up the CPU if the time slice is used up,
+  // or a better process was woken on this CPU.
+  if(myproc() != 0 && myproc()->state == RUNNING)
+    timeslice(which_dev == 2);
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -159,13 +183,136 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// Bring ticks up to date with mtime, and run the timer wheel
+// for the ticks that passed. Hart 0 may have been idle without
+// a tick for a while. Returns 1 if ticks advanced.
+// Caller must hold tickslock.
+int
+ticks_update(void)
+{
+  uint now = r_time() / TICK_INTERVAL - tick_base;
+
+  if((int)(now - ticks) > 0){
+    ticks = now;
+    timer_tick(ticks);
+    return 1;
+  }
+  return 0;
+}
+
+// Set hart 0's timer for its next tick, or for the first
+// high-resolution timer if that is sooner.
+// Runs on hart 0; caller must hold tickslock.
+static void
+clock_program(void)
+{
+  uint64 cmp = (r_time() / TICK_INTERVAL + 1) * TICK_INTERVAL;
+  uint64 when;
+
+  if(hrtimer_next(&when) && when < cmp)
+    cmp = when;
+  *(volatile uint64*)CLINT_MTIMECMP(0) = cmp;
+}
+
+// A high-resolution timer was added ahead of the others.
+// Have hart 0 set its timer for it, directly or, from
+// another hart, with an IPI; see devintr().
+// Caller must hold tickslock.
 void
+clock_rearm(void)
+{
+  if(cpuid() == 0)
+    clock_program();
+  else
+    send_ipi(0);
+}
+
+// Hart 0's timer interrupts and IPIs come here. Runs the timer
+// wheel and the high-resolution timers, and sets the timer for
+// whichever is due next. Its timer may fire between ticks, for
+// a high-resolution timer, and timervec's interval is then off;
+// so it is always set afresh here.
+// Returns 1 if the tick count advanced.
+int
 clockintr()
 {
+  int tick;
+
   acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
+  tick = ticks_update();
+  hrtimer_run(r_time());
+  clock_program();
   release(&tickslock);
+  if(tick)
+    balance_tick();
+  return tick;
+}
+
+// Whether an online hart other than hart 0 is not idle.
+static int
+others_busy(void)
+{
+  int i;
+
+  for(i = 1; i < NCPU; i++)
+    if(is_cpu_online(i) && !atomic_load32(&cpus[i].idle))
+      return 1;
+  return 0;
+}
+
+// Called by an idle hart in scheduler() before wfi.
+// Stop the hart's periodic tick. Hart 0, which keeps time,
+// only asks for an interrupt at the next timer wheel or
+// high-resolution timer deadline, and only if no other hart
+// is busy: their priority boosts and load averages come from
+// balance_tick() on its ticks.
+void
+tick_stop(int hart)
+{
+  uint64 cmp = -1, hr;
+  uint when;
+
+  if(hart == 0){
+    // Publish clock_stopped before looking at the other
+    // harts; tick_start() does the reverse, so either we
+    // see a busy hart or it sees clock_stopped.
+    atomic_store32(&clock_stopped, 1);
+    __sync_synchronize();
+    acquire(&tickslock);
+    if(others_busy()){
+      atomic_store32(&clock_stopped, 0);
+      clock_program();
+      release(&tickslock);
+      return;
+    }
+    if(timer_next(&when))
+      cmp = (tick_base + when) * TICK_INTERVAL;
+    if(hrtimer_next(&hr) && hr < cmp)
+      cmp = hr;
+    release(&tickslock);
+  }
+  *(volatile uint64*)CLINT_MTIMECMP(hart) = cmp;
+}
+
+// Called by a hart in scheduler() once it has stopped
+// idling, whether or not it waited after tick_stop().
+// Restart the periodic tick from the next multiple of
+// TICK_INTERVAL. The caller has cleared its idle flag; if
+// hart 0 stopped its tick meanwhile, wake it to restart it.
+void
+tick_start(int hart)
+{
+  if(hart == 0){
+    acquire(&tickslock);
+    atomic_store32(&clock_stopped, 0);
+    clock_program();
+    release(&tickslock);
+  } else {
+    *(volatile uint64*)CLINT_MTIMECMP(hart) = (r_time() / TICK_INTERVAL + 1) * TICK_INTERVAL;
+    __sync_synchronize();
+    if(atomic_load32(&clock_stopped))
+      send_ipi(0);
+  }
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -177,6 +324,7 @@ int
 devintr()
 {
   uint64 scause = r_scause();
+  int tick;
 
   if((scause & 0x8000000000000000L) &&
      (scause & 0xff) == 9){
@@ -201,20 +349,37 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt, forwarded by timervec in kernelvec.S
+    // from either a machine-mode timer interrupt or a
+    // reschedule IPI sent by another hart.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    // timervec flags timer interrupts. A reschedule IPI only
+    // has to bring an idle hart out of wfi; scheduler() does
+    // the rest.
+    tick = __sync_lock_test_and_set(&timer_scratch[cpuid()][5], 0);
+
+    // hart 0 keeps time. Besides its ticks, its timer fires for
+    // high-resolution timers, and IPIs also ask it to set the
+    // timer for a new one; only an interrupt that advanced
+    // ticks counts as a tick.
+    if(cpuid() == 0)
+      tick = clockintr();
+
+    return tick ? 2 : 1;
   } else {
     return 0;
   }
 }
 
+// ask hart to take a software interrupt, to bring
+// it out of wfi in scheduler().
+void
+send_ipi(int hart)
+{
+  *(volatile uint32*)CLINT_MSIP(hart) = 1;
+}
+
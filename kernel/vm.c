@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -30,6 +32,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT, so that harts can send each other software interrupts.
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
@@ -43,9 +48,6 @@ kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // map kernel stacks
-  proc_mapstacks(kpgtbl);
-  
   return kpgtbl;
 }
 
@@ -160,7 +162,8 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that sbrk() added but were never
+// touched have no mapping, and are skipped.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
@@ -172,10 +175,8 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+    if((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -291,10 +292,12 @@ uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Given a parent process's page table, share
+// its memory with a child's page table.
+// Copies the page table but not the physical
+// memory: writable pages become copy-on-write
+// in both, and are copied by cowfault() on the
+// first store.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
@@ -303,22 +306,18 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   pte_t *pte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+    if((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;  // never touched; the child maps it lazily too
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    }
+    kincref((void*)pa);
+    cond_resched();
   }
   return 0;
 
@@ -327,6 +326,158 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return -1;
 }
 
+// Give the process a private, writable copy of the
+// copy-on-write page at va, after a store to it, or
+// before the kernel writes to it in copyout().
+// The last process sharing the page just takes it over.
+// Returns 0 on success, -1 if va is not a copy-on-write
+// user page or memory is exhausted.
+int
+cowfault(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+
+  if(krefcnt((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+    return 0;
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  kfree((void*)pa);
+  return 0;
+}
+
+// The segment of p's program that va is in, or 0.
+static struct segment*
+findseg(struct proc *p, uint64 va)
+{
+  struct segment *s;
+
+  for(s = p->seg; s < &p->seg[p->nseg]; s++)
+    if(va >= s->va && va - s->va < s->memsz)
+      return s;
+  return 0;
+}
+
+// The page at va of segment s of p's program, with a reference
+// for the caller: the shared page from the page cache if it
+// holds file contents only, else a private page with the file's
+// part copied in and the rest zeroed. Sets *perm to the PTE
+// bits to map it with. Returns 0 on failure.
+static uint64
+segpage(struct proc *p, struct segment *s, uint64 va, int *perm)
+{
+  uint64 off = va - s->va;
+  uint64 pa;
+  char *mem;
+
+  *perm = s->perm;
+  if(off + PGSIZE <= s->filesz){
+    pa = pagecache_get(p->exe, s->off + off);
+    if(s->perm & PTE_W)
+      *perm = (s->perm & ~PTE_W) | PTE_COW;
+    return pa;
+  }
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  if(off < s->filesz){
+    if((pa = pagecache_get(p->exe, s->off + off)) == 0){
+      kfree(mem);
+      return 0;
+    }
+    memmove(mem, (char*)pa, s->filesz - off);
+    kfree((void*)pa);
+  }
+  return (uint64)mem;
+}
+
+// Map the page at va of p, which is within p->sz but was never
+// touched: from p's program if it is in one of its segments,
+// else a zeroed page of the heap that sbrk() added.
+// Returns 0 on success, -1 if va is outside p->sz or already
+// mapped, or memory is exhausted. Paging in from the program
+// may sleep; see uvmprefault() for callers that hold locks.
+int
+lazyfault(struct proc *p, uint64 va)
+{
+  struct segment *s;
+  pte_t *pte;
+  uint64 pa;
+  int perm;
+
+  if(va >= p->sz || va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V))
+    return -1;
+  if((s = findseg(p, va)) != 0){
+    pa = segpage(p, s, va, &perm);
+  } else {
+    pa = (uint64)kalloc();
+    if(pa)
+      memset((void*)pa, 0, PGSIZE);
+    perm = PTE_W|PTE_X|PTE_R;
+  }
+  if(pa == 0)
+    return -1;
+  if(mappages(p->pagetable, va, PGSIZE, pa, perm|PTE_U) != 0){
+    kfree((void*)pa);
+    return -1;
+  }
+  return 0;
+}
+
+// Page in the parts of the current process's program in
+// [va, va+len) that are not mapped yet. Reading them may
+// sleep and takes the program's inode lock, so code that
+// copies to or from user memory while holding a spinlock or
+// an inode lock calls this before taking the lock, and fails
+// if it returns -1. Zero-filled pages need no reading and are
+// left to fault in later.
+int
+uvmprefault(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct segment *s;
+  uint64 a;
+
+  for(a = PGROUNDDOWN(va); a < va + len && a < p->sz; a += PGSIZE){
+    if((s = findseg(p, a)) != 0 && a - s->va < s->filesz &&
+       walkaddr(p->pagetable, a) == 0 && lazyfault(p, a) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// walkaddr() for the copy functions below, which also maps
+// a page of the current process that was never touched.
+static uint64
+uvmaddr(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+
+  pa = walkaddr(pagetable, va);
+  if(pa == 0 && p && pagetable == p->pagetable && lazyfault(p, va) == 0)
+    pa = walkaddr(pagetable, va);
+  return pa;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -347,12 +498,16 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if(uvmaddr(pagetable, va0) == 0)
+      return -1;
+    pte = walk(pagetable, va0, 0);
+    if((*pte & PTE_COW) && cowfault(pagetable, va0) != 0)
       return -1;
+    pa0 = PTE2PA(*pte);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -375,7 +530,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -402,7 +557,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
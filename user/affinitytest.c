@@ -0,0 +1,116 @@
+// Tests for sched_setaffinity() and sched_getaffinity().
+// Pins a child to each online CPU in turn, with CPU hogs
+// around to give stealing and rebalancing something to move,
+// and checks that it is only ever seen on its own CPU, also
+// after sleeping, and that its children inherit the mask.
+// set_cpu() pins too, replacing the mask with its CPU.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NHOG  NCPU
+#define TICKS 20
+
+void
+fail(char *msg)
+{
+  printf("affinitytest: FAILED, %s\n", msg);
+  exit(1);
+}
+
+// runs in a child pinned to cpu.
+void
+pinned(int cpu)
+{
+  int pid, xstatus, end, other;
+
+  if(sched_getaffinity(0) != (1 << cpu))
+    exit(1);
+  if(get_cpu() != cpu)
+    exit(2);
+
+  // set_cpu() to another CPU moves the pin there, if it is online.
+  other = (cpu + 1) % NCPU;
+  if(set_cpu(other) == other){
+    if(sched_getaffinity(0) != (1 << other) || get_cpu() != other)
+      exit(3);
+    if(set_cpu(cpu) != cpu)
+      exit(3);
+  }
+  if(sched_getaffinity(0) != (1 << cpu) || get_cpu() != cpu)
+    exit(3);
+
+  end = uptime() + TICKS;
+  while(uptime() < end){
+    if(get_cpu() != cpu)
+      exit(4);
+    if(uptime() % 4 == 0)
+      sleep(1);
+  }
+
+  pid = fork();
+  if(pid < 0)
+    exit(5);
+  if(pid == 0)
+    exit(sched_getaffinity(0) == (1 << cpu) && get_cpu() == cpu ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(6);
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int hogs[NHOG];
+  int i, cpu, pid, xstatus, online;
+
+  if(sched_getaffinity(0) != (1 << NCPU) - 1)
+    fail("default mask does not allow every CPU");
+  if(sched_setaffinity(0, 0) != -1)
+    fail("empty mask accepted");
+  if(sched_getaffinity(getpid()) != (1 << NCPU) - 1)
+    fail("rejected mask changed the affinity");
+  if(sched_getaffinity(1 << 30) != -1)
+    fail("unknown pid accepted");
+
+  for(i = 0; i < NHOG; i++){
+    hogs[i] = fork();
+    if(hogs[i] < 0)
+      fail("fork");
+    if(hogs[i] == 0)
+      for(;;)
+        ;
+  }
+
+  online = 0;
+  for(cpu = 0; cpu < NCPU; cpu++){
+    pid = fork();
+    if(pid < 0)
+      fail("fork");
+    if(pid == 0){
+      if(sched_setaffinity(0, 1 << cpu) < 0)
+        exit(100);   // cpu is not online
+      pinned(cpu);
+    }
+    wait(&xstatus);
+    if(xstatus == 100)
+      continue;
+    if(xstatus != 0){
+      printf("affinitytest: FAILED, child pinned to cpu %d: check %d\n", cpu, xstatus);
+      exit(1);
+    }
+    online++;
+  }
+
+  for(i = 0; i < NHOG; i++){
+    kill(hogs[i]);
+    wait(0);
+  }
+  if(online == 0)
+    fail("no CPU accepted a single-CPU mask");
+  printf("affinitytest: %d cpus OK\n", online);
+  exit(0);
+}
@@ -0,0 +1,72 @@
+// Context switch stress test for the per-CPU runnable queues.
+// Forks a number of children that do nothing but give up the
+// CPU, so every iteration is one push onto and one pop from a
+// runnable queue. The children are not pinned, so they spread
+// over all online CPUs. Prints the number of switches per second.
+//
+//   cswitch [nchildren [seconds]]
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int nchild = 8;
+  int secs = 5;
+  int fds[2];
+  int i, pid;
+  uint64 count, total;
+
+  if(argc > 1)
+    nchild = atoi(argv[1]);
+  if(argc > 2)
+    secs = atoi(argv[2]);
+  if(nchild < 1 || secs < 1){
+    fprintf(2, "usage: cswitch [nchildren [seconds]]\n");
+    exit(1);
+  }
+
+  if(pipe(fds) < 0){
+    fprintf(2, "cswitch: pipe failed\n");
+    exit(1);
+  }
+
+  printf("cswitch: %d children for %d seconds\n", nchild, secs);
+  int start = uptime();
+  int end = start + secs * HZ;
+
+  for(i = 0; i < nchild; i++){
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "cswitch: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      count = 0;
+      while(uptime() < end){
+        sched_yield();
+        count++;
+      }
+      write(fds[1], &count, sizeof(count));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  total = 0;
+  while(read(fds[0], &count, sizeof(count)) == sizeof(count))
+    total += count;
+  for(i = 0; i < nchild; i++)
+    wait(0);
+
+  int elapsed = uptime() - start;
+  if(elapsed < 1)
+    elapsed = 1;
+  printf("cswitch: %l switches, %l switches/sec\n",
+         total, total * HZ / elapsed);
+  exit(0);
+}
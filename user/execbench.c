@@ -0,0 +1,49 @@
+// Exec microbenchmark. Forks children that exec this same
+// program, which exits at once, and prints the time per
+// fork+exec+exit. With demand paging, a child touches only
+// the few pages it runs, which are shared through the page
+// cache, so an exec costs little more than a fork.
+//
+//   execbench [count]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  char *args[] = { "execbench", "-x", 0 };
+  int n = 200;
+  int i, pid, xstatus;
+  uint64 t;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1){
+    fprintf(2, "usage: execbench [count]\n");
+    exit(1);
+  }
+
+  t = rdtime();
+  for(i = 0; i < n; i++){
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "execbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[0], args);
+      fprintf(2, "execbench: exec %s failed\n", argv[0]);
+      exit(1);
+    }
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  t = rdtime() - t;
+  printf("execbench: %d execs, %l us each\n", n, cycles2us(t / n));
+  exit(0);
+}
@@ -0,0 +1,154 @@
+// Parallel fork/exit benchmark. For 1, 2, ... CPUs, up to the
+// number online, pins one worker to each CPU; every worker forks
+// children that exit at once and waits for them, over and over.
+// Each fork and exit allocates and frees the page tables of a
+// whole process, so this measures how well kalloc() and kfree()
+// scale: forks per second should grow with the number of CPUs.
+//
+// Then it times single forks from a parent grown to larger and
+// larger sizes. Fork shares the parent's pages copy-on-write, so
+// the time per fork should barely depend on the parent's size.
+//
+//   forkbench [forks per worker]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/memlayout.h"
+#include "kernel/procinfo.h"
+#include "user/user.h"
+
+#define MAXGROW (16 * 1024 * 1024)
+
+int online[NCPU];
+
+// fork and reap n children.
+void
+worker(int n)
+{
+  int i, pid;
+
+  for(i = 0; i < n; i++){
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+}
+
+// run one pinned worker on each of the first ncpu online CPUs
+// at once, and return how long it took, in mtime cycles.
+uint64
+run(int ncpu, int n)
+{
+  int start[2];
+  int i, cpu, nworker, pid, xstatus;
+  uint64 t;
+  char c;
+
+  if(pipe(start) < 0){
+    fprintf(2, "forkbench: pipe failed\n");
+    exit(1);
+  }
+  nworker = 0;
+  for(cpu = 0; cpu < NCPU && nworker < ncpu; cpu++){
+    if(!online[cpu])
+      continue;
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(start[1]);
+      if(sched_setaffinity(0, 1 << cpu) < 0 || read(start[0], &c, 1) != 1)
+        exit(1);
+      worker(n);
+      exit(0);
+    }
+    nworker++;
+  }
+
+  close(start[0]);
+  t = rdtime();
+  for(i = 0; i < nworker; i++)
+    write(start[1], "x", 1);
+  close(start[1]);
+  for(i = 0; i < nworker; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      fprintf(2, "forkbench: worker failed\n");
+      exit(1);
+    }
+  }
+  return rdtime() - t;
+}
+
+// grow by size bytes, touching every page so it is really
+// allocated, time n forks, and shrink back. Returns the time
+// per fork in mtime cycles.
+uint64
+forkgrown(int size, int n)
+{
+  char *mem;
+  uint64 t;
+  int i;
+
+  if((mem = sbrk(size)) == (char*)-1){
+    fprintf(2, "forkbench: sbrk failed\n");
+    exit(1);
+  }
+  for(i = 0; i < size; i += 4096)
+    mem[i] = 1;
+
+  t = rdtime();
+  worker(n);
+  t = rdtime() - t;
+
+  sbrk(-size);
+  return t / n;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct cpuinfo ci[NCPU];
+  int n = 1000;
+  int i, ncpu, nonline;
+  uint64 t;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1){
+    fprintf(2, "usage: forkbench [forks per worker]\n");
+    exit(1);
+  }
+
+  if((ncpu = getcpuinfo(ci, NCPU)) < 0){
+    fprintf(2, "forkbench: getcpuinfo failed\n");
+    exit(1);
+  }
+  nonline = 0;
+  for(i = 0; i < ncpu; i++){
+    online[i] = ci[i].online;
+    nonline += online[i];
+  }
+
+  printf("forkbench: %d forks per cpu\n", n);
+  for(i = 1; i <= nonline; i++){
+    t = run(i, n);
+    if(t == 0)
+      t = 1;
+    printf("%d cpus: %l forks/sec\n", i, (uint64)n * i * MTIME_HZ / t);
+  }
+
+  for(i = 0; i <= MAXGROW; i = i ? i * 4 : 1024 * 1024){
+    t = forkgrown(i, n / 10 + 1);
+    printf("parent +%d KB: %l us/fork\n", i / 1024, cycles2us(t));
+  }
+  exit(0);
+}
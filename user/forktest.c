@@ -1,11 +1,15 @@
 // Test that fork fails gracefully.
 // Tiny executable so that the limit can be filling the proc table.
 
+#include "kernel/param.h"
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/procinfo.h"
 #include "user/user.h"
 
-#define N  1000
+#define N  2000
+
+struct procinfo info[NPROC];
 
 void
 print(const char *s)
@@ -33,6 +37,13 @@ forktest(void)
     exit(1);
   }
 
+  // The children are zombies until waited for, so every
+  // slot should still be in use.
+  if(getprocinfo(info, NPROC) != NPROC){
+    print("fork failed before the process table was full\n");
+    exit(1);
+  }
+
   for(; n > 0; n--){
     if(wait(0) < 0){
       print("wait stopped early\n");
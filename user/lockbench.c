@@ -0,0 +1,138 @@
+// Spinlock microbenchmark. For 1, 2, ... CPUs, up to the
+// number online, pins one process to each CPU and has them all
+// acquire and release the same kernel spinlock. Prints the
+// acquire throughput and the median, 99th percentile and worst
+// wait to acquire. Build with make LOCK=TAS and make LOCK=TICKET
+// to compare the two spinlocks.
+//
+//   lockbench [iterations]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/memlayout.h"
+#include "kernel/procinfo.h"
+#include "kernel/lockbench.h"
+#include "user/user.h"
+
+
+int online[NCPU];
+struct lockbench total;
+
+// the wait below which a fraction num/den of all acquires fell.
+uint64
+percentile(uint64 n, int num, int den)
+{
+  uint64 sum = 0;
+  int b;
+
+  for(b = 0; b < LB_NHIST; b++){
+    sum += total.hist[b];
+    if(sum * den >= n * num)
+      break;
+  }
+  return b == 0 ? 0 : 1L << b;
+}
+
+// pin a process to each of the first ncpu online CPUs, and
+// have them all run lockbench() at once.
+void
+run(int ncpu, int iters)
+{
+  int start[2], res[NCPU][2];
+  struct lockbench lb;
+  int i, cpu, n, pid;
+  uint64 acquires, elapsed;
+
+  if(pipe(start) < 0){
+    fprintf(2, "lockbench: pipe failed\n");
+    exit(1);
+  }
+  n = 0;
+  for(cpu = 0; cpu < NCPU && n < ncpu; cpu++){
+    if(!online[cpu])
+      continue;
+    if(pipe(res[n]) < 0){
+      fprintf(2, "lockbench: pipe failed\n");
+      exit(1);
+    }
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "lockbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      char c;
+      close(start[1]);
+      close(res[n][0]);
+      if(sched_setaffinity(0, 1 << cpu) < 0 || read(start[0], &c, 1) != 1)
+        exit(1);
+      if(lockbench(iters, &lb) < 0)
+        exit(1);
+      write(res[n][1], &lb, sizeof(lb));
+      exit(0);
+    }
+    close(res[n][1]);
+    n++;
+  }
+
+  // Let them all go at once.
+  close(start[0]);
+  for(i = 0; i < n; i++)
+    write(start[1], "x", 1);
+  close(start[1]);
+
+  memset(&total, 0, sizeof(total));
+  for(i = 0; i < n; i++){
+    if(read(res[i][0], &lb, sizeof(lb)) != sizeof(lb)){
+      fprintf(2, "lockbench: child %d failed\n", i);
+      exit(1);
+    }
+    close(res[i][0]);
+    if(lb.elapsed > total.elapsed)
+      total.elapsed = lb.elapsed;
+    if(lb.max > total.max)
+      total.max = lb.max;
+    for(int b = 0; b < LB_NHIST; b++)
+      total.hist[b] += lb.hist[b];
+  }
+  for(i = 0; i < n; i++)
+    wait(0);
+
+  acquires = (uint64)iters * n;
+  elapsed = total.elapsed ? total.elapsed : 1;
+  printf("%d cpus: %l acquires/ms, wait p50 %l ns, p99 %l ns, max %l ns\n",
+         n, acquires * (MTIME_HZ / 1000) / elapsed,
+         cycles2ns(percentile(acquires, 1, 2)), cycles2ns(percentile(acquires, 99, 100)),
+         cycles2ns(total.max));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct cpuinfo ci[NCPU];
+  int iters = 100000;
+  int i, n, nonline;
+
+  if(argc > 1)
+    iters = atoi(argv[1]);
+  if(iters < 1){
+    fprintf(2, "usage: lockbench [iterations]\n");
+    exit(1);
+  }
+
+  if((n = getcpuinfo(ci, NCPU)) < 0){
+    fprintf(2, "lockbench: getcpuinfo failed\n");
+    exit(1);
+  }
+  nonline = 0;
+  for(i = 0; i < n; i++){
+    online[i] = ci[i].online;
+    nonline += online[i];
+  }
+
+  printf("lockbench: %d acquires per cpu, waits rounded up to a power of two\n", iters);
+  for(i = 1; i <= nonline; i++)
+    run(i, iters);
+  exit(0);
+}
@@ -0,0 +1,61 @@
+// Print spinlock statistics, most contended lock names first.
+//
+//   lockstat [-r] [count]
+//
+// Shows the count most contended names, 10 by default. -r
+// clears the counters after printing them, so the next run
+// covers only what happened in between.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+
+struct lockstat stats[NLOCKSTAT];
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat t;
+  int reset = 0;
+  int count = 10;
+  int i, j, n;
+
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-r") == 0)
+      reset = 1;
+    else if((count = atoi(argv[i])) < 1){
+      fprintf(2, "usage: lockstat [-r] [count]\n");
+      exit(1);
+    }
+  }
+
+  if((n = lockstat(stats, NLOCKSTAT, reset)) < 0){
+    fprintf(2, "lockstat: not built with LOCKSTAT=ON\n");
+    exit(1);
+  }
+
+  // Sort by contended acquisitions, then by time spent spinning.
+  for(i = 1; i < n; i++){
+    t = stats[i];
+    for(j = i; j > 0 && (stats[j-1].contended < t.contended ||
+        (stats[j-1].contended == t.contended && stats[j-1].spins < t.spins)); j--)
+      stats[j] = stats[j-1];
+    stats[j] = t;
+  }
+
+  // Hold times come from mtime, not the CPU cycle counter, so
+  // they are only as fine as one mtime cycle.
+  printf("hold times in ns, at mtime resolution (%l ns)\n", cycles2ns(1));
+  printf("name\t\tacquire\tcontend\tspins\tavg hold ns\tmax hold ns\n");
+  for(i = 0; i < n && i < count; i++){
+    printf("%s\t", stats[i].name);
+    if(strlen(stats[i].name) < 8)
+      printf("\t");
+    printf("%l\t%l\t%l\t%l\t\t%l\n", stats[i].acquire, stats[i].contended, stats[i].spins,
+           stats[i].acquire ? cycles2ns(stats[i].hold / stats[i].acquire) : 0,
+           cycles2ns(stats[i].maxhold));
+  }
+  exit(0);
+}
@@ -0,0 +1,35 @@
+// Run a command with a different nice value.
+//
+//   nice n command [arg ...]
+//
+// n is from -20 (most favoured) to 19.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  char *s;
+  int n;
+
+  if(argc < 3){
+    fprintf(2, "usage: nice n command [arg ...]\n");
+    exit(1);
+  }
+
+  // atoi() does not take a sign.
+  s = argv[1];
+  n = atoi(s[0] == '-' ? s + 1 : s);
+  if(s[0] == '-')
+    n = -n;
+
+  if(setpriority(0, n) < 0){
+    fprintf(2, "nice: bad nice value %s\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "nice: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -0,0 +1,116 @@
+// Check that every forked child gets to run, whichever CPUs
+// the kernel places it on, and that set_cpu() accepts exactly
+// the CPUs getcpuinfo() reports online. Works with however
+// many harts were booted; a child left on the queue of a hart
+// that never came up makes it time out.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/procinfo.h"
+#include "user/user.h"
+
+#define NFORK   20
+#define TIMEOUT 100   // ticks
+
+struct report {
+  int want;   // cpu asked for with set_cpu(), or -1
+  int got;    // set_cpu()'s result
+  int ran;    // get_cpu() after that
+};
+
+int
+main(int argc, char *argv[])
+{
+  int fds[2];
+  int i, n, pid, nchild, nonline;
+  int online[NCPU], used[NCPU];
+  struct cpuinfo ci[NCPU];
+  struct report r;
+
+  if(getcpuinfo(ci, NCPU) != NCPU){
+    fprintf(2, "onlinetest: getcpuinfo failed\n");
+    exit(1);
+  }
+  nonline = 0;
+  for(i = 0; i < NCPU; i++){
+    online[i] = ci[i].online;
+    used[i] = 0;
+    nonline += online[i];
+  }
+  if(nonline == 0 || !online[0]){
+    printf("onlinetest: FAILED, cpu 0 is not online\n");
+    exit(1);
+  }
+
+  if(pipe(fds) < 0){
+    fprintf(2, "onlinetest: pipe failed\n");
+    exit(1);
+  }
+
+  int parent = getpid();
+  int watchdog = fork();
+  if(watchdog == 0){
+    sleep(TIMEOUT);
+    printf("onlinetest: FAILED, a child never ran\n");
+    kill(parent);
+    exit(1);
+  }
+
+  // One child per possible CPU, each asking to move there,
+  // plus plain children placed by the kernel.
+  nchild = NCPU + NFORK;
+  for(i = 0; i < nchild; i++){
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "onlinetest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      r.want = i < NCPU ? i : -1;
+      r.got = r.want >= 0 ? set_cpu(r.want) : -1;
+      r.ran = get_cpu();
+      write(fds[1], &r, sizeof(r));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  n = 0;
+  while(read(fds[0], &r, sizeof(r)) == sizeof(r)){
+    n++;
+    if(r.ran < 0 || r.ran >= NCPU || !online[r.ran]){
+      printf("onlinetest: FAILED, a child ran on cpu %d, which is not online\n", r.ran);
+      exit(1);
+    }
+    used[r.ran] = 1;
+    if(r.want < 0)
+      continue;
+    if(r.got != (online[r.want] ? r.want : -1)){
+      printf("onlinetest: FAILED, set_cpu(%d) returned %d\n", r.want, r.got);
+      exit(1);
+    }
+    if(r.got >= 0 && r.ran != r.got){
+      printf("onlinetest: FAILED, set_cpu(%d) left the child on cpu %d\n", r.want, r.ran);
+      exit(1);
+    }
+  }
+  for(i = 0; i < nchild; i++)
+    wait(0);
+  kill(watchdog);
+  wait(0);
+
+  if(n != nchild){
+    printf("onlinetest: FAILED, %d of %d children reported\n", n, nchild);
+    exit(1);
+  }
+  for(i = 0; i < NCPU; i++){
+    if(online[i] && !used[i]){
+      printf("onlinetest: FAILED, no child ran on online cpu %d\n", i);
+      exit(1);
+    }
+  }
+  printf("onlinetest: %d children ran on %d online cpus: OK\n", n, nonline);
+  exit(0);
+}
@@ -0,0 +1,104 @@
+// Pipe ping-pong benchmark for wakeup placement.
+// Two processes bounce a byte back and forth through a pair of
+// pipes, so every message wakes the other side. For each
+// scheduling policy, reports the round-trip time and how often
+// either side found itself on a different CPU than last time.
+//
+//   pingpong [rounds]
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+// bounce rounds messages between rfd and wfd, and return the
+// number of times get_cpu() changed. The parent sends first.
+int
+bounce(int rfd, int wfd, int rounds, int first)
+{
+  int i, cpu, last = get_cpu(), moves = 0;
+  char c = 'x';
+
+  for(i = 0; i < rounds; i++){
+    if(first && write(wfd, &c, 1) != 1)
+      break;
+    if(read(rfd, &c, 1) != 1)
+      break;
+    if(!first && write(wfd, &c, 1) != 1)
+      break;
+    cpu = get_cpu();
+    if(cpu != last)
+      moves++;
+    last = cpu;
+  }
+  return moves;
+}
+
+void
+run(int policy, int rounds)
+{
+  int ping[2], pong[2], res[2];
+  int moves, childmoves, start, elapsed;
+
+  if(set_sched_policy(policy) < 0){
+    fprintf(2, "pingpong: set_sched_policy failed\n");
+    exit(1);
+  }
+  if(pipe(ping) < 0 || pipe(pong) < 0 || pipe(res) < 0){
+    fprintf(2, "pingpong: pipe failed\n");
+    exit(1);
+  }
+  int pid = fork();
+  if(pid < 0){
+    fprintf(2, "pingpong: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    close(res[0]);
+    childmoves = bounce(ping[0], pong[1], rounds, 0);
+    write(res[1], &childmoves, sizeof(childmoves));
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+  close(res[1]);
+
+  start = uptime();
+  moves = bounce(pong[0], ping[1], rounds, 1);
+  elapsed = uptime() - start;
+
+  childmoves = 0;
+  read(res[0], &childmoves, sizeof(childmoves));
+  close(ping[1]);
+  close(pong[0]);
+  close(res[0]);
+  wait(0);
+
+  if(elapsed < 1)
+    elapsed = 1;
+  printf("%s: %d round trips, %d us each, %d migrations\n", schedname(policy),
+         rounds, elapsed * (1000000 / HZ) / rounds, moves + childmoves);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rounds = 10000;
+  int policy, old;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds < 1){
+    fprintf(2, "usage: pingpong [rounds]\n");
+    exit(1);
+  }
+
+  old = get_sched_policy();
+  for(policy = 0; policy < NSCHED; policy++)
+    run(policy, rounds);
+  set_sched_policy(old);
+  exit(0);
+}
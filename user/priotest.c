@@ -0,0 +1,150 @@
+// Tests for setpriority() and getpriority(), then a latency
+// test: how long a pipe ping-pong takes while CPU hogs run,
+// with the hogs at nice 0 and at nice 19. The hogs sink to
+// lower levels, and a woken ping-pong process should preempt
+// them at once, so a round trip must take well under a tick
+// on average. Without preemption each wakeup would wait for
+// a hog's time slice to run out.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/memlayout.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+#define NHOG   (2 * NCPU)
+#define ROUNDS 200
+
+void
+fail(char *msg)
+{
+  printf("priotest: FAILED, %s\n", msg);
+  exit(1);
+}
+
+// pid's nice value, from getpriority().
+int
+getnice(int pid)
+{
+  int nice;
+
+  if(getpriority(pid, &nice) != 0)
+    fail("getpriority() of a live process");
+  return nice;
+}
+
+void
+apitest(void)
+{
+  int pid, xstatus, nice;
+
+  if(getnice(0) != 0)
+    fail("initial nice value is not 0");
+  if(setpriority(0, 5) != 0 || getnice(0) != 5 || getnice(getpid()) != 5)
+    fail("setpriority(0, 5) did not stick");
+  if(setpriority(0, NICE_MAX + 1) != -1 || setpriority(0, NICE_MIN - 1) != -1)
+    fail("out of range nice value accepted");
+  if(getnice(0) != 5)
+    fail("rejected setpriority() changed the nice value");
+
+  pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    // wait for the parent to renice us.
+    while(getnice(0) == 5)
+      sleep(1);
+    exit(getnice(0) + 100);
+  }
+  if(getnice(pid) != 5)
+    fail("child did not inherit the nice value");
+  if(setpriority(pid, NICE_MIN) != 0)
+    fail("setpriority() of a child");
+  wait(&xstatus);
+  if(xstatus != NICE_MIN + 100)
+    fail("child did not see its new nice value");
+
+  if(getpriority(pid, &nice) != -1 || setpriority(pid, 0) != -1)
+    fail("unknown pid accepted");
+  setpriority(0, 0);
+}
+
+// the average time of a pipe round trip, in mtime cycles,
+// with NHOG hogs at nice hognice.
+uint64
+latency(int hognice)
+{
+  int hogs[NHOG];
+  int ping[2], pong[2];
+  int i, pid;
+  uint64 start, elapsed;
+  char c = 'x';
+
+  for(i = 0; i < NHOG; i++){
+    hogs[i] = fork();
+    if(hogs[i] < 0)
+      fail("fork");
+    if(hogs[i] == 0){
+      setpriority(0, hognice);
+      for(;;)
+        ;
+    }
+  }
+
+  if(pipe(ping) < 0 || pipe(pong) < 0)
+    fail("pipe");
+  pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  // let the hogs use up their first time slices and sink.
+  sleep(HZ / 2);
+
+  start = rdtime();
+  for(i = 0; i < ROUNDS; i++){
+    write(ping[1], &c, 1);
+    read(pong[0], &c, 1);
+  }
+  elapsed = rdtime() - start;
+
+  close(ping[1]);
+  close(pong[0]);
+  wait(0);
+  for(i = 0; i < NHOG; i++){
+    kill(hogs[i]);
+    wait(0);
+  }
+  return elapsed / ROUNDS;
+}
+
+void
+latencytest(int hognice)
+{
+  uint64 t = latency(hognice);
+
+  printf("%d hogs at nice %d: %l us per round trip\n", NHOG, hognice, cycles2us(t));
+  if(t >= TICK_INTERVAL)
+    fail("woken process did not preempt the hogs");
+}
+
+int
+main(int argc, char *argv[])
+{
+  apitest();
+  printf("priotest: setpriority/getpriority OK\n");
+
+  latencytest(0);
+  latencytest(NICE_MAX);
+  printf("priotest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,146 @@
+// Scheduling latency benchmark.
+// A probe process sleeps for one tick at a time and measures, with
+// rdtime(), how long after the tick it actually gets to run. Ticks
+// fall on multiples of TICK_INTERVAL of mtime. It reports the
+// average and worst delay on an idle system, and then again with a
+// background load of big forks, fork/exec and file create/unlink,
+// which keeps processes in long kernel paths.
+//
+//   schedlat [samples]
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/memlayout.h"
+#include "user/user.h"
+
+#define NLOAD   3                 // processes of each kind of load
+#define BIGMEM  (2 * 1024 * 1024) // size of the forking processes
+#define FILEBLK 64                // 1KB blocks per file
+
+int loadpids[3 * NLOAD];
+int nload;
+
+void
+startload(void (*fn)(int), int arg)
+{
+  int pid = fork();
+  if(pid < 0){
+    fprintf(2, "schedlat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    fn(arg);
+    exit(0);
+  }
+  loadpids[nload++] = pid;
+}
+
+// fork a big process over and over: uvmcopy(), then freeing it all.
+void
+forker(int arg)
+{
+  if(sbrk(BIGMEM) == (char*)-1)
+    exit(1);
+  memset(sbrk(0) - BIGMEM, 1, BIGMEM);
+  for(;;){
+    int pid = fork();
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+}
+
+// fork and exec a process that exits at once.
+void
+execer(int arg)
+{
+  char *argv[] = { "schedlat", "-x", 0 };
+
+  for(;;){
+    int pid = fork();
+    if(pid == 0){
+      exec(argv[0], argv);
+      exit(1);
+    }
+    wait(0);
+  }
+}
+
+// write and unlink a file: writei(), the log, and itrunc().
+void
+filer(int arg)
+{
+  char name[] = "latX";
+  char buf[1024];
+  int fd, i;
+
+  name[3] = 'a' + arg;
+  memset(buf, 'x', sizeof(buf));
+  for(;;){
+    if((fd = open(name, O_CREATE | O_RDWR)) < 0)
+      exit(1);
+    for(i = 0; i < FILEBLK; i++)
+      write(fd, buf, sizeof(buf));
+    close(fd);
+    unlink(name);
+  }
+}
+
+// sleep for a tick samples times; report how late we ran.
+void
+probe(char *what, int samples)
+{
+  uint64 t0, tick, delay, total = 0, worst = 0;
+  int i;
+
+  for(i = 0; i < samples; i++){
+    t0 = rdtime();
+    sleep(1);
+    tick = (t0 / TICK_INTERVAL + 1) * TICK_INTERVAL;
+    delay = rdtime() - tick;
+    total += delay;
+    if(delay > worst)
+      worst = delay;
+  }
+  printf("%s: avg %l us, worst %l us\n", what,
+         cycles2us(total / samples), cycles2us(worst));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int samples = 50;
+  int i;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);
+  if(argc > 1)
+    samples = atoi(argv[1]);
+  if(samples < 1){
+    fprintf(2, "usage: schedlat [samples]\n");
+    exit(1);
+  }
+
+  probe("idle", samples);
+
+  for(i = 0; i < NLOAD; i++){
+    startload(forker, i);
+    startload(execer, i);
+    startload(filer, i);
+  }
+  sleep(2);
+  probe("loaded", samples);
+
+  for(i = 0; i < nload; i++)
+    kill(loadpids[i]);
+  for(i = 0; i < nload; i++)
+    wait(0);
+  for(i = 0; i < NLOAD; i++){
+    char name[] = "latX";
+    name[3] = 'a' + i;
+    unlink(name);
+  }
+  exit(0);
+}
@@ -0,0 +1,39 @@
+// Show or switch the kernel's scheduling policy.
+//
+//   schedpolicy            print the current policy
+//   schedpolicy rr|least|p2c
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int policy, old;
+
+  if(argc < 2){
+    policy = get_sched_policy();
+    if(schedname(policy) == 0){
+      fprintf(2, "schedpolicy: unknown policy %d\n", policy);
+      exit(1);
+    }
+    printf("%s\n", schedname(policy));
+    exit(0);
+  }
+
+  for(policy = 0; policy < NSCHED; policy++)
+    if(strcmp(argv[1], schedname(policy)) == 0)
+      break;
+  if(policy == NSCHED){
+    fprintf(2, "usage: schedpolicy [rr|least|p2c]\n");
+    exit(1);
+  }
+  if((old = set_sched_policy(policy)) < 0){
+    fprintf(2, "schedpolicy: set_sched_policy failed\n");
+    exit(1);
+  }
+  printf("%s -> %s\n", schedname(old), schedname(policy));
+  exit(0);
+}
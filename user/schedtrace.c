@@ -0,0 +1,182 @@
+// Dump and summarize the kernel's scheduler trace.
+//
+//   schedtrace       per-CPU utilization and run-queue wait times
+//   schedtrace -v    also print every event, oldest first
+//
+// The summary covers the span of time that all the CPUs' trace
+// rings still hold.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define NWAIT 1024   // pids tracked at once for run-queue waits
+
+char *types[] = {
+[TRACE_SWITCH_IN]  "in",
+[TRACE_SWITCH_OUT] "out",
+[TRACE_WAKEUP]     "wakeup",
+[TRACE_MIGRATE]    "migrate",
+[TRACE_FORK]       "fork",
+[TRACE_EXIT]       "exit",
+};
+
+char *states[] = { "unused", "used", "sleep", "runble", "run", "zombie" };
+
+struct trace_event *ev[NCPU];
+int nev[NCPU];
+
+// since when each pid has been waiting on a run queue, or 0.
+struct {
+  int pid;
+  uint64 since;
+} waiting[NWAIT];
+
+uint64 runstart[NCPU], busy[NCPU];
+uint64 nwaits, waitsum, waitmax;
+
+void
+runnable(int pid, uint64 t)
+{
+  waiting[pid % NWAIT].pid = pid;
+  waiting[pid % NWAIT].since = t;
+}
+
+void
+print(struct trace_event *e, uint64 t0)
+{
+  printf("%l us: cpu %d pid %d ", cycles2us(e->time - t0), e->cpu, e->pid);
+  if(e->type >= 0 && e->type < sizeof(types)/sizeof(types[0]) && types[e->type])
+    printf("%s", types[e->type]);
+  else
+    printf("type %d", e->type);
+  if(e->type == TRACE_SWITCH_IN)
+    printf(" level %d", e->arg);
+  else if(e->type == TRACE_SWITCH_OUT && e->arg >= 0 && e->arg < sizeof(states)/sizeof(states[0]))
+    printf(" %s", states[e->arg]);
+  else if(e->type == TRACE_WAKEUP)
+    printf(" by cpu %d", e->arg);
+  else if(e->type == TRACE_MIGRATE)
+    printf(" from cpu %d", e->arg);
+  else if(e->type == TRACE_FORK)
+    printf(" child %d", e->arg);
+  else if(e->type == TRACE_EXIT)
+    printf(" status %d", e->arg);
+  printf("\n");
+}
+
+void
+account(struct trace_event *e)
+{
+  int w;
+  uint64 d;
+
+  switch(e->type){
+  case TRACE_SWITCH_IN:
+    runstart[e->cpu] = e->time;
+    w = e->pid % NWAIT;
+    if(waiting[w].pid == e->pid && waiting[w].since){
+      d = e->time - waiting[w].since;
+      nwaits++;
+      waitsum += d;
+      if(d > waitmax)
+        waitmax = d;
+      waiting[w].since = 0;
+    }
+    break;
+  case TRACE_SWITCH_OUT:
+    if(runstart[e->cpu]){
+      busy[e->cpu] += e->time - runstart[e->cpu];
+      runstart[e->cpu] = 0;
+    }
+    if(e->arg == 3)   // RUNNABLE: preempted or yielded
+      runnable(e->pid, e->time);
+    break;
+  case TRACE_WAKEUP:
+    runnable(e->pid, e->time);
+    break;
+  case TRACE_FORK:
+    runnable(e->arg, e->time);
+    break;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+  int pos[NCPU];
+  int cpu, best, total;
+  uint64 t0, t1, span;
+
+  total = 0;
+  for(cpu = 0; cpu < NCPU; cpu++){
+    ev[cpu] = malloc(NTRACE * sizeof(struct trace_event));
+    if(ev[cpu] == 0){
+      fprintf(2, "schedtrace: out of memory\n");
+      exit(1);
+    }
+    nev[cpu] = trace_read(cpu, ev[cpu], NTRACE);
+    if(nev[cpu] < 0){
+      fprintf(2, "schedtrace: trace_read failed\n");
+      exit(1);
+    }
+    pos[cpu] = 0;
+    total += nev[cpu];
+  }
+  if(total == 0){
+    printf("schedtrace: no events\n");
+    exit(0);
+  }
+
+  // Only the span every non-empty ring covers is complete.
+  t0 = 0;
+  t1 = 0;
+  for(cpu = 0; cpu < NCPU; cpu++){
+    if(nev[cpu] == 0)
+      continue;
+    if(ev[cpu][0].time > t0)
+      t0 = ev[cpu][0].time;
+    if(t1 == 0 || ev[cpu][nev[cpu]-1].time > t1)
+      t1 = ev[cpu][nev[cpu]-1].time;
+  }
+
+  // Merge the rings, each already in time order.
+  for(;;){
+    best = -1;
+    for(cpu = 0; cpu < NCPU; cpu++)
+      if(pos[cpu] < nev[cpu] &&
+         (best == -1 || ev[cpu][pos[cpu]].time < ev[best][pos[best]].time))
+        best = cpu;
+    if(best == -1)
+      break;
+    struct trace_event *e = &ev[best][pos[best]++];
+    if(e->time < t0)
+      continue;
+    if(verbose)
+      print(e, t0);
+    if(e->cpu >= 0 && e->cpu < NCPU)
+      account(e);
+  }
+
+  // Count processes still running at the end.
+  for(cpu = 0; cpu < NCPU; cpu++)
+    if(runstart[cpu])
+      busy[cpu] += t1 - runstart[cpu];
+
+  span = t1 - t0;
+  if(span == 0)
+    span = 1;
+  printf("%d events over %l us\n", total, cycles2us(span));
+  for(cpu = 0; cpu < NCPU; cpu++){
+    if(nev[cpu] == 0)
+      continue;
+    printf("cpu %d: %d events, %l%% busy\n", cpu, nev[cpu], busy[cpu] * 100 / span);
+  }
+  if(nwaits)
+    printf("run queue wait: %l waits, avg %l us, max %l us\n",
+           nwaits, cycles2us(waitsum / nwaits), cycles2us(waitmax));
+  exit(0);
+}
@@ -0,0 +1,69 @@
+// Tests for the sleep timer wheel and nanosleep().
+// Sleepers with deadlines spread over both of the lowest wheel
+// levels must each wake no earlier than asked, and nanosleep()
+// must never return before its time according to rdtime(), nor
+// round a sleep shorter than a tick up to a whole tick.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/memlayout.h"
+#include "user/user.h"
+
+#define NSLEEPER 12
+#define NTRY     5   // nanosleep() tries per length; the best counts
+
+void
+fail(char *msg)
+{
+  printf("timertest: FAILED, %s\n", msg);
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, pid, xstatus, start;
+  uint64 t0, ns, cycles, best;
+
+  // 1 to 100 ticks, so some timers start on level 1 and are
+  // cascaded down to level 0.
+  for(i = 0; i < NSLEEPER; i++){
+    pid = fork();
+    if(pid < 0)
+      fail("fork");
+    if(pid == 0){
+      int n = 1 + i * 9;
+      start = uptime();
+      if(sleep(n) < 0)
+        exit(2);
+      exit(uptime() - start >= n ? 0 : 1);
+    }
+  }
+  for(i = 0; i < NSLEEPER; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      fail("sleep() returned early");
+  }
+
+  for(ns = 1000; ns <= 300000000; ns *= 10){
+    best = -1;
+    for(i = 0; i < NTRY; i++){
+      t0 = rdtime();
+      if(nanosleep(ns) < 0)
+        fail("nanosleep");
+      cycles = rdtime() - t0;
+      if(cycles2ns(cycles) < ns)
+        fail("nanosleep() returned early");
+      if(cycles < best)
+        best = cycles;
+    }
+    printf("nanosleep(%l ns): %l ns\n", ns, cycles2ns(best));
+    if(ns < cycles2ns(TICK_INTERVAL) / 2 &&
+       cycles2ns(best) >= ns + cycles2ns(TICK_INTERVAL) / 2)
+      fail("nanosleep() waited for a tick");
+  }
+
+  printf("timertest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,140 @@
+// Show per-CPU and per-process CPU usage, like top.
+// Every interval, prints how busy each CPU was and, busiest
+// first, how each process spent the interval: running in user
+// space and in the kernel, and waiting on a runnable queue.
+//
+//   top [seconds [count]]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/procinfo.h"
+#include "user/user.h"
+
+#define NSHOW 20   // processes listed per interval
+
+char *states[] = { "unused", "used", "sleep", "runble", "run", "zombie" };
+
+struct procinfo *cur, *prev;
+int ncur, nprev;
+struct cpuinfo cpus[NCPU], prevcpus[NCPU];
+
+// per-process usage over the interval, in mtime cycles.
+struct usage {
+  struct procinfo *pi;
+  uint64 user, sys, wait;
+  int vcsw, ivcsw;
+} use[NPROC];
+
+// percentage of span, to one decimal place, as tenths.
+int
+permille(uint64 t, uint64 span)
+{
+  return t * 1000 / span;
+}
+
+struct procinfo*
+findprev(int pid)
+{
+  for(int i = 0; i < nprev; i++)
+    if(prev[i].pid == pid)
+      return &prev[i];
+  return 0;
+}
+
+void
+show(uint64 span)
+{
+  struct procinfo *p, *old;
+  struct usage u;
+  int i, j, n, pm;
+
+  for(i = 0; i < NCPU; i++){
+    if(!cpus[i].online)
+      continue;
+    pm = permille(cpus[i].busy - prevcpus[i].busy, span);
+    printf("cpu %d: %d.%d%% busy, %d procs\n", i, pm / 10, pm % 10, cpus[i].nproc);
+  }
+
+  // Keep use[] sorted by time on CPU, busiest first.
+  n = 0;
+  for(i = 0; i < ncur; i++){
+    p = &cur[i];
+    old = findprev(p->pid);
+    u.pi = p;
+    u.user = p->utime - (old ? old->utime : 0);
+    u.sys = p->stime - (old ? old->stime : 0);
+    u.wait = p->wtime - (old ? old->wtime : 0);
+    u.vcsw = p->nvcsw - (old ? old->nvcsw : 0);
+    u.ivcsw = p->nivcsw - (old ? old->nivcsw : 0);
+    for(j = n; j > 0 && use[j-1].user + use[j-1].sys < u.user + u.sys; j--)
+      use[j] = use[j-1];
+    use[j] = u;
+    n++;
+  }
+
+  printf("pid\tstate   cpu lvl nice\tuser%%\tsys%%\twait%%\tvcsw\tivcsw  name\n");
+  for(i = 0; i < n && i < NSHOW; i++){
+    p = use[i].pi;
+    printf("%d\t%s  %d   %d   %d", p->pid,
+           p->state >= 0 && p->state < sizeof(states)/sizeof(states[0]) ? states[p->state] : "???",
+           p->cpu, p->level, p->nice);
+    pm = permille(use[i].user, span);
+    printf("\t%d.%d", pm / 10, pm % 10);
+    pm = permille(use[i].sys, span);
+    printf("\t%d.%d", pm / 10, pm % 10);
+    pm = permille(use[i].wait, span);
+    printf("\t%d.%d", pm / 10, pm % 10);
+    printf("\t%d\t%d  %s\n", use[i].vcsw, use[i].ivcsw, p->name);
+  }
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int secs = 1;
+  int count = 5;
+  struct procinfo *t;
+  uint64 now, last;
+
+  if(argc > 1)
+    secs = atoi(argv[1]);
+  if(argc > 2)
+    count = atoi(argv[2]);
+  if(secs < 1 || count < 1){
+    fprintf(2, "usage: top [seconds [count]]\n");
+    exit(1);
+  }
+
+  cur = malloc(NPROC * sizeof(struct procinfo));
+  prev = malloc(NPROC * sizeof(struct procinfo));
+  if(cur == 0 || prev == 0){
+    fprintf(2, "top: out of memory\n");
+    exit(1);
+  }
+
+  last = rdtime();
+  if((nprev = getprocinfo(prev, NPROC)) < 0 || getcpuinfo(prevcpus, NCPU) < 0){
+    fprintf(2, "top: getprocinfo failed\n");
+    exit(1);
+  }
+
+  while(count-- > 0){
+    sleep(secs * HZ);
+    now = rdtime();
+    if((ncur = getprocinfo(cur, NPROC)) < 0 || getcpuinfo(cpus, NCPU) < 0){
+      fprintf(2, "top: getprocinfo failed\n");
+      exit(1);
+    }
+    show(now > last ? now - last : 1);
+
+    t = prev;
+    prev = cur;
+    cur = t;
+    nprev = ncur;
+    memmove(prevcpus, cpus, sizeof(cpus));
+    last = now;
+  }
+  exit(0);
+}
@@ -1,6 +1,8 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/memlayout.h"
+#include "kernel/sched.h"
 #include "user/user.h"
 
 char*
@@ -134,3 +136,43 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// cycles of the CLINT's mtime counter since boot,
+// at MTIME_HZ (kernel/memlayout.h).
+uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("csrr %0, time" : "=r" (x));
+  return x;
+}
+
+// mtime cycles, such as differences of rdtime(),
+// in microseconds and in nanoseconds.
+uint64
+cycles2us(uint64 cycles)
+{
+  return cycles / (MTIME_HZ / 1000000);
+}
+
+uint64
+cycles2ns(uint64 cycles)
+{
+  return cycles * (1000000000 / MTIME_HZ);
+}
+
+static char *schednames[NSCHED] = {
+[SCHED_RR]    "rr",
+[SCHED_LEAST] "least",
+[SCHED_P2C]   "p2c",
+};
+
+// The name of scheduling policy policy (kernel/sched.h),
+// or 0 if there is no such policy.
+char*
+schedname(int policy)
+{
+  if(policy < 0 || policy >= NSCHED)
+    return 0;
+  return schednames[policy];
+}
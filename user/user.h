@@ -1,5 +1,10 @@
 struct stat;
 struct rtcdate;
+struct trace_event;
+struct procinfo;
+struct cpuinfo;
+struct lockbench;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -26,6 +31,19 @@ int uptime(void);
 int set_cpu(int);
 int get_cpu();
 int cpu_process_count(int);
+int set_sched_policy(int);
+int get_sched_policy(void);
+int setpriority(int, int);
+int getpriority(int, int*);
+int sched_setaffinity(int, uint);
+int sched_getaffinity(int);
+int nanosleep(uint64);
+int trace_read(int, struct trace_event*, int);
+int getprocinfo(struct procinfo*, int);
+int getcpuinfo(struct cpuinfo*, int);
+int lockbench(int, struct lockbench*);
+int lockstat(struct lockstat*, int, int);
+int sched_yield(void);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -42,4 +60,8 @@ void* malloc(uint);
 void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
+uint64 rdtime(void);
+uint64 cycles2us(uint64);
+uint64 cycles2ns(uint64);
+char* schedname(int);
 void *memcpy(void *, const void *, uint);
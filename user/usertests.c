@@ -669,6 +669,42 @@ void dirtest(char *s)
   }
 }
 
+// a running program's file can be neither written nor
+// truncated, since its pages are read in on demand.
+void
+textbusy(char *s)
+{
+  int fd;
+  char c;
+
+  // write back the byte that is there, so that the file
+  // is intact even if the write goes through.
+  fd = open("usertests", O_RDWR);
+  if(fd < 0){
+    printf("%s: open usertests failed\n", s);
+    exit(1);
+  }
+  if(read(fd, &c, 1) != 1){
+    printf("%s: read usertests failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("usertests", O_WRONLY);
+  if(fd < 0){
+    printf("%s: open usertests for writing failed\n", s);
+    exit(1);
+  }
+  if(write(fd, &c, 1) != -1){
+    printf("%s: wrote to a running program\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(open("usertests", O_WRONLY|O_TRUNC) >= 0){
+    printf("%s: truncated a running program\n", s);
+    exit(1);
+  }
+}
+
 void
 exectest(char *s)
 {
@@ -2041,12 +2077,13 @@ iref(char *s)
 }
 
 // test that fork fails gracefully
-// the forktest binary also does this, but it runs out of proc entries first.
-// inside the bigger usertests binary, we run out of memory first.
+// the forktest binary also does this, and checks that it runs out of
+// proc entries first. inside the bigger usertests binary, memory may
+// run out first.
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = 2000 };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -2063,7 +2100,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
     exit(1);
   }
 
@@ -2850,6 +2887,7 @@ main(int argc, char *argv[])
     {sharedfd, "sharedfd"},
     {dirtest, "dirtest"},
     {exectest, "exectest"},
+    {textbusy, "textbusy"},
     {bigargtest, "bigargtest"},
     {bigwrite, "bigwrite"},
     {bsstest, "bsstest"},
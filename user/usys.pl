@@ -38,4 +38,17 @@ entry("sleep");
 entry("uptime");
 entry("set_cpu");
 entry("get_cpu");
-entry("cpu_process_count");
\ No newline at end of file
+entry("cpu_process_count");
+entry("set_sched_policy");
+entry("get_sched_policy");
+entry("setpriority");
+entry("getpriority");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("nanosleep");
+entry("trace_read");
+entry("getprocinfo");
+entry("getcpuinfo");
+entry("lockbench");
+entry("lockstat");
+entry("sched_yield");
@@ -0,0 +1,117 @@
+// Wakeup microbenchmark.
+// Parks a growing number of processes asleep on channels of
+// their own (each blocked reading its own pipe), and times a
+// pipe ping-pong between two other processes. Every round trip
+// costs two wakeup()s, so the time per round should stay flat
+// as the number of unrelated sleepers grows.
+//
+// A sleeper keeps both ends of its pipe and the parent keeps
+// neither, so the read never returns; the parent kill()s the
+// sleepers at the end. That way the parent's file table does
+// not limit how many there can be.
+//
+//   wakebench [rounds]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXSLEEPERS 256
+#define STEP 64
+
+int sleeper[MAXSLEEPERS];
+int nsleepers;
+
+// start one more process that sleeps until it is killed.
+void
+addsleeper(void)
+{
+  int fds[2];
+  char c;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "wakebench: pipe failed\n");
+    exit(1);
+  }
+  int pid = fork();
+  if(pid < 0){
+    fprintf(2, "wakebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    read(fds[0], &c, 1);
+    exit(0);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sleeper[nsleepers++] = pid;
+}
+
+// time rounds ping-pong exchanges with a partner process,
+// in mtime cycles.
+uint64
+pingpong(int rounds)
+{
+  int ping[2], pong[2];
+  char c = 'x';
+  int i;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    fprintf(2, "wakebench: pipe failed\n");
+    exit(1);
+  }
+  int pid = fork();
+  if(pid < 0){
+    fprintf(2, "wakebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  uint64 start = rdtime();
+  for(i = 0; i < rounds; i++){
+    write(ping[1], &c, 1);
+    read(pong[0], &c, 1);
+  }
+  uint64 elapsed = rdtime() - start;
+
+  close(ping[1]);
+  close(pong[0]);
+  wait(0);
+  return elapsed;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rounds = 20000;
+  int i, target;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds < 1){
+    fprintf(2, "usage: wakebench [rounds]\n");
+    exit(1);
+  }
+
+  printf("wakebench: %d round trips per step\n", rounds);
+  for(target = 0; target <= MAXSLEEPERS; target += STEP){
+    while(nsleepers < target)
+      addsleeper();
+    printf("%d sleepers: %l ns per round trip\n", nsleepers,
+           cycles2ns(pingpong(rounds)) / rounds);
+  }
+
+  for(i = 0; i < nsleepers; i++)
+    kill(sleeper[i]);
+  for(i = 0; i < nsleepers; i++)
+    wait(0);
+  exit(0);
+}